@@ -0,0 +1,458 @@
+#include "aio.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#  include <poll.h>
+#endif
+
+#if HAS_IO_URING
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  include <sys/mman.h>
+#  include <sys/uio.h>
+#endif
+
+static void
+finish(struct chck_aio_request *request)
+{
+   assert(request && request->aio);
+   struct chck_aio *aio = request->aio;
+
+   if (request->result > 0)
+      request->buffer->curpos += request->result;
+
+   --aio->pending;
+   request->aio = NULL;
+
+   if (aio->callback)
+      aio->callback(request);
+}
+
+static void
+work(struct chck_aio_request **data)
+{
+   assert(data && *data);
+   struct chck_aio_request *request = *data;
+
+   // transfer everything, unless the file ends or errors
+   size_t done = 0;
+   while (done < request->size) {
+      void *ptr = request->buffer->curpos + done;
+      const size_t left = request->size - done;
+
+      ssize_t ret;
+      if (request->op == CHCK_AIO_READ) {
+         ret = (request->offset < 0 ? read(request->fd, ptr, left) : pread(request->fd, ptr, left, request->offset + done));
+      } else {
+         ret = (request->offset < 0 ? write(request->fd, ptr, left) : pwrite(request->fd, ptr, left, request->offset + done));
+      }
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret < 0) {
+         request->result = (done ? (ssize_t)done : -errno);
+         return;
+      }
+
+      if (ret == 0)
+         break;
+
+      done += ret;
+   }
+
+   request->result = done;
+}
+
+static void
+on_done(struct chck_aio_request **data)
+{
+   assert(data && *data);
+   finish(*data);
+}
+
+#if HAS_IO_URING
+static void
+ring_release(struct chck_aio *aio)
+{
+   assert(aio);
+
+   if (aio->ring.sqes)
+      munmap(aio->ring.sqes, aio->ring.sqes_size);
+
+   if (aio->ring.cq && aio->ring.cq != aio->ring.sq)
+      munmap(aio->ring.cq, aio->ring.cq_size);
+
+   if (aio->ring.sq)
+      munmap(aio->ring.sq, aio->ring.sq_size);
+
+   if (aio->ring.fd >= 0)
+      close(aio->ring.fd);
+
+   memset(&aio->ring, 0, sizeof(aio->ring));
+   aio->ring.fd = -1;
+}
+
+static bool
+ring(struct chck_aio *aio)
+{
+   assert(aio);
+
+   if (aio->depth > UINT32_MAX)
+      return false;
+
+   struct io_uring_params p;
+   memset(&p, 0, sizeof(p));
+
+   if ((aio->ring.fd = syscall(__NR_io_uring_setup, (unsigned)aio->depth, &p)) < 0)
+      return false;
+
+   aio->ring.features = p.features;
+   aio->ring.sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+   aio->ring.cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+   // with single mmap, both rings are in one mapping
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+      aio->ring.sq_size = aio->ring.cq_size = (aio->ring.sq_size > aio->ring.cq_size ? aio->ring.sq_size : aio->ring.cq_size);
+
+   if ((aio->ring.sq = mmap(NULL, aio->ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring.fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+      aio->ring.sq = NULL;
+      goto fail;
+   }
+
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+      aio->ring.cq = aio->ring.sq;
+   } else if ((aio->ring.cq = mmap(NULL, aio->ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring.fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+      aio->ring.cq = NULL;
+      goto fail;
+   }
+
+   aio->ring.sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+   if ((aio->ring.sqes = mmap(NULL, aio->ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring.fd, IORING_OFF_SQES)) == MAP_FAILED) {
+      aio->ring.sqes = NULL;
+      goto fail;
+   }
+
+   aio->ring.sq_head = aio->ring.sq + p.sq_off.head;
+   aio->ring.sq_tail = aio->ring.sq + p.sq_off.tail;
+   aio->ring.sq_mask = aio->ring.sq + p.sq_off.ring_mask;
+   aio->ring.sq_array = aio->ring.sq + p.sq_off.array;
+   aio->ring.cq_head = aio->ring.cq + p.cq_off.head;
+   aio->ring.cq_tail = aio->ring.cq + p.cq_off.tail;
+   aio->ring.cq_mask = aio->ring.cq + p.cq_off.ring_mask;
+   aio->ring.cqes = aio->ring.cq + p.cq_off.cqes;
+
+   // kernel may round the entries up, but we never have more than depth in flight
+   if (aio->fd >= 0 && syscall(__NR_io_uring_register, aio->ring.fd, IORING_REGISTER_EVENTFD, &aio->fd, 1) != 0)
+      goto fail;
+
+   return true;
+
+fail:
+   ring_release(aio);
+   return false;
+}
+
+static bool
+ring_submit(struct chck_aio *aio, struct chck_aio_request *request)
+{
+   assert(aio && request);
+
+   // with offset -1, older kernels would read from offset 0 instead
+   if (request->offset < 0 && !(aio->ring.features & IORING_FEAT_RW_CUR_POS))
+      return false;
+
+   // only we write the tail, kernel moves the head
+   const unsigned tail = *aio->ring.sq_tail;
+   const unsigned index = tail & *aio->ring.sq_mask;
+
+   struct io_uring_sqe *sqe = (struct io_uring_sqe*)aio->ring.sqes + index;
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+   // readv/writev work on older kernels than plain read/write
+   // result is what was already transferred, when resubmitting after short transfer
+   request->iov.base = request->buffer->curpos + request->result;
+   request->iov.len = request->size - request->result;
+   sqe->opcode = (request->op == CHCK_AIO_READ ? IORING_OP_READV : IORING_OP_WRITEV);
+   sqe->fd = request->fd;
+   sqe->off = (uint64_t)(request->offset < 0 ? request->offset : request->offset + request->result);
+   sqe->addr = (uint64_t)(uintptr_t)&request->iov;
+   sqe->len = 1;
+   sqe->user_data = (uint64_t)(uintptr_t)request;
+
+   aio->ring.sq_array[index] = index;
+   __atomic_store_n(aio->ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+   ++aio->ring.queued;
+   return true;
+}
+
+static void
+ring_fail(struct chck_aio *aio, int error)
+{
+   assert(aio);
+
+   // entries the kernel did not take are turned into nops, so nothing in the ring points to the requests anymore
+   const unsigned tail = *aio->ring.sq_tail;
+   for (unsigned head = __atomic_load_n(aio->ring.sq_head, __ATOMIC_ACQUIRE); head != tail; ++head) {
+      struct io_uring_sqe *sqe = (struct io_uring_sqe*)aio->ring.sqes + aio->ring.sq_array[head & *aio->ring.sq_mask];
+      struct chck_aio_request *request = (struct chck_aio_request*)(uintptr_t)sqe->user_data;
+
+      if (!request)
+         continue;
+
+      memset(sqe, 0, sizeof(struct io_uring_sqe));
+      sqe->opcode = IORING_OP_NOP;
+
+      request->result = (request->result > 0 ? request->result : -error);
+      finish(request);
+   }
+}
+
+static bool
+ring_flush(struct chck_aio *aio)
+{
+   assert(aio);
+
+   while (aio->ring.queued) {
+      const int ret = syscall(__NR_io_uring_enter, aio->ring.fd, aio->ring.queued, 0, 0, NULL, 0);
+
+      if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY))
+         continue;
+
+      if (ret < 0) {
+         const int error = errno;
+         ring_fail(aio, error);
+         errno = error;
+         return false;
+      }
+
+      aio->ring.queued -= ret;
+   }
+
+   return true;
+}
+
+static void
+ring_collect(struct chck_aio *aio)
+{
+   assert(aio);
+
+   unsigned head = *aio->ring.cq_head;
+   while (head != __atomic_load_n(aio->ring.cq_tail, __ATOMIC_ACQUIRE)) {
+      const struct io_uring_cqe *cqe = (const struct io_uring_cqe*)aio->ring.cqes + (head & *aio->ring.cq_mask);
+      struct chck_aio_request *request = (struct chck_aio_request*)(uintptr_t)cqe->user_data;
+      const int res = cqe->res;
+
+      // free the entry before the callback, it may submit more
+      __atomic_store_n(aio->ring.cq_head, ++head, __ATOMIC_RELEASE);
+
+      // nop left behind by ring_fail
+      if (!request)
+         continue;
+
+      // like work(), transfer everything, unless the file ends or errors
+      if (res > 0 && (size_t)(request->result += res) < request->size && ring_submit(aio, request))
+         continue;
+
+      if (res < 0 && !request->result)
+         request->result = res;
+
+      finish(request);
+      head = *aio->ring.cq_head;
+   }
+}
+#endif
+
+bool
+chck_aio_submit(struct chck_aio *aio, struct chck_aio_request *request)
+{
+   assert(aio && request && request->buffer);
+
+   if (aio->pending >= aio->depth || request->aio)
+      return false;
+
+   struct chck_buffer *buf = request->buffer;
+   const size_t used = buf->curpos - buf->buffer;
+
+   if (request->op == CHCK_AIO_READ) {
+      // make room for the whole read
+      size_t sz;
+      if (unlikely(chck_add_ofsz(used, request->size, &sz)))
+         return false;
+
+      if (sz > buf->size && !chck_buffer_resize(buf, sz))
+         return false;
+   } else if (request->size > buf->size - used) {
+      return false;
+   }
+
+   request->aio = aio;
+   request->result = 0;
+
+#if HAS_IO_URING
+   if (aio->uring) {
+      if (!ring_submit(aio, request)) {
+         request->aio = NULL;
+         return false;
+      }
+
+      ++aio->pending;
+      return true;
+   }
+#endif
+
+   if (!chck_tqueue_add_task(&aio->tqueue, &request, 0)) {
+      request->aio = NULL;
+      return false;
+   }
+
+   ++aio->pending;
+   return true;
+}
+
+bool
+chck_aio_flush(struct chck_aio *aio)
+{
+   assert(aio);
+
+#if HAS_IO_URING
+   if (aio->uring)
+      return ring_flush(aio);
+#endif
+
+   return true;
+}
+
+size_t
+chck_aio_collect(struct chck_aio *aio)
+{
+   assert(aio);
+
+#if HAS_IO_URING
+   if (aio->uring) {
+      ring_flush(aio);
+
+      // drain the eventfd, completions are read from the ring anyways
+      uint64_t v;
+      if (aio->fd >= 0)
+         read(aio->fd, &v, sizeof(v));
+
+      ring_collect(aio);
+
+      // resubmitted short transfers and requests submitted from callbacks
+      ring_flush(aio);
+      return aio->pending;
+   }
+#endif
+
+   chck_tqueue_collect(&aio->tqueue);
+   return aio->pending;
+}
+
+size_t
+chck_aio_wait(struct chck_aio *aio)
+{
+   assert(aio);
+
+   // until at least one request completes
+   while (aio->pending) {
+      const size_t before = aio->pending;
+      if (chck_aio_collect(aio) < before)
+         break;
+
+#ifdef __linux__
+      // entries still queued failed to flush, kernel won't signal for them
+      if (aio->fd >= 0 && !aio->ring.queued) {
+         struct pollfd pfd = { .fd = aio->fd, .events = POLLIN };
+         poll(&pfd, 1, -1);
+         continue;
+      }
+#endif
+
+      usleep(100);
+   }
+
+   return aio->pending;
+}
+
+int
+chck_aio_get_fd(const struct chck_aio *aio)
+{
+   assert(aio);
+   return aio->fd;
+}
+
+void
+chck_aio_release(struct chck_aio *aio)
+{
+   if (!aio)
+      return;
+
+   // requests can't be left in kernel's hands, they point to our memory
+   while (aio->pending && chck_aio_wait(aio));
+
+#if HAS_IO_URING
+   if (aio->uring)
+      ring_release(aio);
+#endif
+
+   if (!aio->uring)
+      chck_tqueue_release(&aio->tqueue);
+
+   if (aio->fd >= 0)
+      close(aio->fd);
+
+   memset(aio, 0, sizeof(struct chck_aio));
+}
+
+bool
+chck_aio(struct chck_aio *aio, size_t depth, size_t nthreads, bool uring, void (*callback)(struct chck_aio_request *request))
+{
+   assert(aio && depth > 0 && nthreads > 0);
+   memset(aio, 0, sizeof(struct chck_aio));
+   aio->ring.fd = aio->fd = -1;
+
+   if (unlikely(!depth) || unlikely(!nthreads))
+      return false;
+
+   aio->depth = depth;
+   aio->callback = callback;
+
+#ifdef __linux__
+   if ((aio->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+      return false;
+#endif
+
+#if HAS_IO_URING
+   if (uring && ring(aio)) {
+      aio->uring = true;
+      return true;
+   }
+#else
+   (void)uring;
+#endif
+
+   if (!chck_tqueue(&aio->tqueue, nthreads, depth, sizeof(struct chck_aio_request*), work, on_done, NULL))
+      goto fail;
+
+   chck_tqueue_set_keep_alive(&aio->tqueue, true, 0);
+
+   if (aio->fd >= 0)
+      chck_tqueue_set_fd(&aio->tqueue, aio->fd);
+
+   return true;
+
+fail:
+   if (aio->fd >= 0)
+      close(aio->fd);
+
+   aio->fd = -1;
+   return false;
+}
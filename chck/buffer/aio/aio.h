@@ -0,0 +1,92 @@
+#ifndef __chck_aio__
+#define __chck_aio__
+
+#include <chck/macros.h>
+#include <chck/buffer/buffer.h>
+#include <chck/thread/queue/queue.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+enum chck_aio_op {
+   CHCK_AIO_READ,
+   CHCK_AIO_WRITE,
+};
+
+struct chck_aio;
+
+struct chck_aio_request {
+   // read size bytes from fd to curpos of buffer, or write size bytes from curpos of buffer to fd
+   struct chck_buffer *buffer;
+   size_t size;
+   int fd;
+   enum chck_aio_op op;
+
+   // file offset, -1 uses (and moves) the current file position
+   off_t offset;
+
+   void *userdata;
+
+   // bytes transferred, or -errno, valid in the callback
+   // less than size only when the file ends, or errors after some bytes were transferred
+   ssize_t result;
+
+   // private
+   struct chck_aio *aio;
+   struct { void *base; size_t len; } iov;
+};
+
+struct chck_aio {
+   // io_uring, when available
+   struct {
+      void *sq, *cq, *sqes;
+      size_t sq_size, cq_size, sqes_size;
+      unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+      unsigned *cq_head, *cq_tail, *cq_mask;
+      void *cqes;
+
+      // submission entries queued, but not yet handed to kernel
+      unsigned queued, features;
+      int fd;
+   } ring;
+
+   // thread pool fallback
+   struct chck_tqueue tqueue;
+
+   void (*callback)(struct chck_aio_request *request);
+
+   // requests in flight, and the most there may be
+   size_t pending, depth;
+
+   // eventfd that becomes readable when requests complete
+   int fd;
+   bool uring;
+};
+
+/**
+ * Asynchronous reads and writes to chck_buffer.
+ * Requests are ran through io_uring when the kernel supports it (-DHAS_IO_URING=1), otherwise on chck_tqueue thread pool of nthreads threads.
+ * uring false always uses the thread pool.
+ *
+ * Reads grow the buffer to fit size bytes at curpos, writes need the bytes to be there already.
+ * Once the request completes, curpos is moved by the bytes transferred (like chck_buffer_write_from_fd), and callback(request) is ran by chck_aio_collect.
+ * Request and its buffer belong to the aio until the callback, don't have more than one request in flight for same buffer.
+ *
+ * chck_aio_submit returns false when there already are depth requests in flight, collect some first.
+ * With io_uring the requests are queued and handed to the kernel in one go by chck_aio_flush (chck_aio_collect flushes too).
+ * If the kernel refuses the queued requests, they complete with -errno and flush returns false.
+ * The fd returned by chck_aio_get_fd becomes readable when requests complete, flush before waiting for it.
+ * With io_uring, offset -1 needs kernel that supports reading from the current position (5.6), otherwise submit returns false.
+ *
+ * Like chck_tqueue, everything must be done from the thread that created the aio.
+ */
+
+CHCK_NONULL bool chck_aio(struct chck_aio *aio, size_t depth, size_t nthreads, bool uring, void (*callback)(struct chck_aio_request *request));
+void chck_aio_release(struct chck_aio *aio);
+CHCK_NONULL bool chck_aio_submit(struct chck_aio *aio, struct chck_aio_request *request);
+CHCK_NONULL bool chck_aio_flush(struct chck_aio *aio);
+CHCK_NONULL size_t chck_aio_collect(struct chck_aio *aio);
+CHCK_NONULL size_t chck_aio_wait(struct chck_aio *aio);
+CHCK_NONULL int chck_aio_get_fd(const struct chck_aio *aio);
+
+#endif /* __chck_aio__ */
@@ -0,0 +1,174 @@
+#include "aio.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#define FILE_SIZE (256 * 1024)
+#define CHUNK 4096
+
+static size_t completed;
+
+static void
+done(struct chck_aio_request *request)
+{
+   assert(request && request->result == (ssize_t)request->size);
+   ++completed;
+}
+
+static size_t failed;
+
+static void
+fail(struct chck_aio_request *request)
+{
+   assert(request);
+   ++failed;
+}
+
+static void
+run(bool uring)
+{
+   char path[] = "/tmp/chck_aio_XXXXXX";
+   int fd;
+   assert((fd = mkstemp(path)) >= 0);
+   unlink(path);
+
+   uint8_t *data;
+   assert((data = malloc(FILE_SIZE)));
+   for (size_t i = 0; i < FILE_SIZE; ++i)
+      data[i] = (i * 7) & 0xFF;
+
+   struct chck_aio aio;
+   assert(chck_aio(&aio, 16, 4, uring, done));
+
+   /* TEST: writes */
+   {
+      completed = 0;
+      struct chck_buffer buf;
+      assert(chck_buffer_from_pointer(&buf, data, FILE_SIZE, CHCK_ENDIANESS_NATIVE));
+
+      // one request per buffer, so each chunk gets its own view
+      struct chck_buffer views[FILE_SIZE / CHUNK];
+      struct chck_aio_request requests[FILE_SIZE / CHUNK];
+      memset(requests, 0, sizeof(requests));
+
+      for (size_t i = 0; i < FILE_SIZE / CHUNK; ++i) {
+         assert(chck_buffer_from_pointer(&views[i], data + i * CHUNK, CHUNK, CHCK_ENDIANESS_NATIVE));
+         requests[i] = (struct chck_aio_request){ .buffer = &views[i], .size = CHUNK, .fd = fd, .op = CHCK_AIO_WRITE, .offset = i * CHUNK };
+
+         // depth is smaller than the number of requests
+         while (!chck_aio_submit(&aio, &requests[i]))
+            chck_aio_wait(&aio);
+      }
+
+      while (chck_aio_wait(&aio));
+      assert(completed == FILE_SIZE / CHUNK);
+
+      for (size_t i = 0; i < FILE_SIZE / CHUNK; ++i)
+         assert(views[i].curpos == views[i].buffer + CHUNK);
+
+      // can't write what is not in the buffer
+      struct chck_aio_request big = { .buffer = &buf, .size = FILE_SIZE + 1, .fd = fd, .op = CHCK_AIO_WRITE };
+      assert(!chck_aio_submit(&aio, &big));
+      chck_buffer_release(&buf);
+   }
+
+   /* TEST: reads grow the buffer */
+   {
+      completed = 0;
+      struct chck_buffer bufs[FILE_SIZE / CHUNK];
+      struct chck_aio_request requests[FILE_SIZE / CHUNK];
+      memset(requests, 0, sizeof(requests));
+
+      for (size_t i = 0; i < FILE_SIZE / CHUNK; ++i) {
+         assert(chck_buffer(&bufs[i], 1, CHCK_ENDIANESS_NATIVE));
+         requests[i] = (struct chck_aio_request){ .buffer = &bufs[i], .size = CHUNK, .fd = fd, .op = CHCK_AIO_READ, .offset = (FILE_SIZE / CHUNK - 1 - i) * CHUNK };
+
+         while (!chck_aio_submit(&aio, &requests[i]))
+            chck_aio_wait(&aio);
+      }
+
+      // wait through the fd
+      assert(chck_aio_flush(&aio));
+      assert(chck_aio_get_fd(&aio) >= 0);
+      while (chck_aio_wait(&aio));
+      assert(completed == FILE_SIZE / CHUNK);
+
+      for (size_t i = 0; i < FILE_SIZE / CHUNK; ++i) {
+         assert(bufs[i].size >= CHUNK && bufs[i].curpos == bufs[i].buffer + CHUNK);
+         assert(!memcmp(bufs[i].buffer, data + (FILE_SIZE / CHUNK - 1 - i) * CHUNK, CHUNK));
+         chck_buffer_release(&bufs[i]);
+      }
+   }
+
+   /* TEST: short reads are continued */
+   {
+      completed = 0;
+      int fds[2];
+      assert(pipe(fds) == 0);
+
+      // only half is there when the read is submitted
+      assert(write(fds[1], data, CHUNK / 2) == CHUNK / 2);
+
+      struct chck_buffer buf;
+      assert(chck_buffer(&buf, CHUNK, CHCK_ENDIANESS_NATIVE));
+      struct chck_aio_request request = { .buffer = &buf, .size = CHUNK, .fd = fds[0], .op = CHCK_AIO_READ, .offset = -1 };
+      assert(chck_aio_submit(&aio, &request));
+      assert(chck_aio_flush(&aio));
+
+      // let the first readv complete short before rest arrives
+      usleep(10 * 1000);
+      assert(chck_aio_collect(&aio) == 1);
+      assert(write(fds[1], data + CHUNK / 2, CHUNK / 2) == CHUNK / 2);
+
+      while (chck_aio_wait(&aio));
+      assert(completed == 1);
+      assert(buf.curpos == buf.buffer + CHUNK && !memcmp(buf.buffer, data, CHUNK));
+      chck_buffer_release(&buf);
+      close(fds[0]);
+      close(fds[1]);
+   }
+
+   /* TEST: requests the kernel refuses complete with error */
+   if (aio.uring) {
+      failed = 0;
+      aio.callback = fail;
+
+      struct chck_buffer buf;
+      assert(chck_buffer(&buf, CHUNK, CHCK_ENDIANESS_NATIVE));
+      struct chck_aio_request request = { .buffer = &buf, .size = CHUNK, .fd = fd, .op = CHCK_AIO_READ, .offset = 0 };
+      assert(chck_aio_submit(&aio, &request));
+
+      const int rfd = aio.ring.fd;
+      aio.ring.fd = -1;
+      assert(!chck_aio_flush(&aio));
+      assert(failed == 1 && request.result == -EBADF && buf.curpos == buf.buffer);
+
+      // nothing is in flight, so this must not block
+      assert(!chck_aio_wait(&aio));
+      aio.ring.fd = rfd;
+
+      // the refused entry was left as nop for the kernel, it's skipped
+      assert(chck_aio_submit(&aio, &request));
+      assert(!chck_aio_wait(&aio));
+      assert(failed == 2 && request.result == CHUNK);
+      chck_buffer_release(&buf);
+      aio.callback = done;
+   }
+
+   chck_aio_release(&aio);
+   close(fd);
+   free(data);
+}
+
+int main(void)
+{
+   run(true);
+   run(false);
+   return EXIT_SUCCESS;
+}
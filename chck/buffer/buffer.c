@@ -3,9 +3,13 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if HAS_ZLIB
 #  include <zlib.h>
+#  include <limits.h>
 #endif
 
 static inline bool
@@ -17,15 +21,25 @@ valid_bits(enum chck_bits bits)
            bits == CHCK_BUFFER_B64);
 }
 
-void
-chck_buffer_flush(struct chck_buffer *buf)
+static void
+release_storage(struct chck_buffer *buf)
 {
    assert(buf);
 
-   if (buf->copied)
+   if (buf->mapped) {
+      munmap(buf->buffer, buf->size);
+   } else if (buf->copied) {
       free(buf->buffer);
+   }
 
-   buf->copied = false;
+   buf->copied = buf->mapped = false;
+}
+
+void
+chck_buffer_flush(struct chck_buffer *buf)
+{
+   assert(buf);
+   release_storage(buf);
    buf->curpos = buf->buffer = NULL;
 }
 
@@ -45,6 +59,7 @@ chck_buffer_from_pointer(struct chck_buffer *buf, void *ptr, size_t size, enum c
    assert(buf);
    memset(buf, 0, sizeof(struct chck_buffer));
    buf->step = 32;
+   buf->growth = 2;
    chck_buffer_set_pointer(buf, ptr, size, endianess);
    return true;
 }
@@ -74,8 +89,8 @@ chck_buffer_set_pointer(struct chck_buffer *buf, void *ptr, size_t size, enum ch
 {
    assert(buf);
 
-   if (buf->copied) {
-      free(buf->buffer);
+   if (buf->copied || buf->mapped) {
+      release_storage(buf);
       buf->buffer = NULL;
    }
 
@@ -90,6 +105,59 @@ chck_buffer_set_pointer(struct chck_buffer *buf, void *ptr, size_t size, enum ch
    buf->copied = false;
 }
 
+bool
+chck_buffer_map_file(struct chck_buffer *buf, const char *path, enum chck_buffer_map mode, enum chck_endianess endianess)
+{
+   assert(buf && path);
+   memset(buf, 0, sizeof(struct chck_buffer));
+
+   if (unlikely(!path))
+      return false;
+
+   const bool write = (mode & CHCK_BUFFER_MAP_WRITE);
+
+   int fd;
+   if ((fd = open(path, (write ? O_RDWR : O_RDONLY) | O_CLOEXEC)) < 0)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, &st) != 0 || st.st_size < 0 || (uintmax_t)st.st_size > SIZE_MAX)
+      goto fail;
+
+   // mmap refuses zero length, empty file is just an empty buffer
+   if (!st.st_size) {
+      close(fd);
+      return chck_buffer_from_pointer(buf, NULL, 0, endianess);
+   }
+
+   int flags = (write ? MAP_SHARED : MAP_PRIVATE);
+#ifdef MAP_POPULATE
+   if (mode & CHCK_BUFFER_MAP_POPULATE)
+      flags |= MAP_POPULATE;
+#endif
+
+   void *data;
+   if ((data = mmap(NULL, st.st_size, PROT_READ | (write ? PROT_WRITE : 0), flags, fd, 0)) == MAP_FAILED)
+      goto fail;
+
+   // the mapping keeps its own reference to the file
+   close(fd);
+
+   if (mode & CHCK_BUFFER_MAP_SEQUENTIAL) {
+      madvise(data, st.st_size, MADV_SEQUENTIAL);
+   } else if (mode & CHCK_BUFFER_MAP_RANDOM) {
+      madvise(data, st.st_size, MADV_RANDOM);
+   }
+
+   chck_buffer_from_pointer(buf, data, st.st_size, endianess);
+   buf->mapped = true;
+   return true;
+
+fail:
+   close(fd);
+   return false;
+}
+
 bool
 chck_buffer_resize(struct chck_buffer *buf, size_t size)
 {
@@ -104,8 +172,17 @@ chck_buffer_resize(struct chck_buffer *buf, size_t size)
    }
 
    void *tmp = NULL;
-   if (!(tmp = realloc((buf->copied ? buf->buffer : NULL), size)))
+   if (buf->mapped) {
+      // can't grow a file mapping in place, move the contents to heap
+      if (!(tmp = malloc(size)))
+         return false;
+
+      memcpy(tmp, buf->buffer, (size < buf->size ? size : buf->size));
+      munmap(buf->buffer, buf->size);
+      buf->mapped = false;
+   } else if (!(tmp = realloc((buf->copied ? buf->buffer : NULL), size))) {
       return false;
+   }
 
    /* set new buffer position */
    if (buf->curpos - buf->buffer > (ptrdiff_t)size) {
@@ -152,6 +229,30 @@ chck_buffer_seek(struct chck_buffer *buf, long offset, int whence)
    return buf->curpos - buf->buffer;
 }
 
+static size_t
+grow_size(const struct chck_buffer *buf, size_t needed)
+{
+   assert(buf);
+
+   size_t grow = buf->step;
+   if (buf->growth > 1) {
+      size_t sz;
+      if (unlikely(chck_mul_ofsz(buf->size, buf->growth - 1, &sz)))
+         sz = SIZE_MAX;
+
+      grow = (sz > grow ? sz : grow);
+   }
+
+   if (buf->max_step > 0 && grow > buf->max_step)
+      grow = buf->max_step;
+
+   size_t sz;
+   if (unlikely(chck_add_ofsz(buf->size, grow, &sz)))
+      sz = SIZE_MAX;
+
+   return (sz > needed ? sz : needed);
+}
+
 static bool
 bounds_check(struct chck_buffer *buf, size_t size, size_t memb)
 {
@@ -159,19 +260,43 @@ bounds_check(struct chck_buffer *buf, size_t size, size_t memb)
    if (unlikely(chck_mul_ofsz(size, memb, &nsz)))
       return false;
 
-   size_t sz = buf->size - (buf->curpos - buf->buffer);
-   if (nsz > sz) {
-      /* buf->size + size * memb + buf->step */
-      if (unlikely(chck_add_ofsz(buf->size, nsz, &nsz)) || unlikely(chck_add_ofsz(buf->step, nsz, &nsz)))
+   const size_t pos = buf->curpos - buf->buffer;
+   if (nsz > buf->size - pos) {
+      if (unlikely(chck_add_ofsz(pos, nsz, &nsz)))
          return false;
 
-      if (!chck_buffer_resize(buf, nsz))
+      if (!chck_buffer_resize(buf, grow_size(buf, nsz)))
          return false;
    }
 
    return true;
 }
 
+bool
+chck_buffer_reserve(struct chck_buffer *buf, size_t size)
+{
+   assert(buf);
+
+   const size_t pos = buf->curpos - buf->buffer;
+   if (size <= buf->size - pos)
+      return true;
+
+   size_t sz;
+   if (unlikely(chck_add_ofsz(pos, size, &sz)))
+      return false;
+
+   return chck_buffer_resize(buf, sz);
+}
+
+void
+chck_buffer_set_growth(struct chck_buffer *buf, size_t step, unsigned int growth, size_t max_step)
+{
+   assert(buf);
+   buf->step = step;
+   buf->growth = growth;
+   buf->max_step = max_step;
+}
+
 size_t
 chck_buffer_fill(const void *src, size_t size, size_t memb, struct chck_buffer *buf)
 {
@@ -437,31 +562,49 @@ bool
 chck_buffer_decompress_zlib(struct chck_buffer *buf)
 {
 #if HAS_ZLIB
-   size_t dsize, bsize;
-
-   {
-      size_t sz;
-      if (unlikely(chck_mul_ofsz(buf->size, 2, &sz)))
-         return false;
-
-      dsize = bsize = sz;
-   }
+   size_t dsize = 0, bsize;
+   if (unlikely(chck_mul_ofsz(buf->size, 2, &bsize)) || !bsize)
+      return false;
 
    void *decompressed;
-   if (!(decompressed = malloc(dsize)))
+   if (!(decompressed = malloc(bsize)))
       return false;
 
-   int ret;
-   while ((ret = uncompress(decompressed, &dsize, buf->buffer, buf->size)) == Z_BUF_ERROR) {
-      void *tmp;
-      if (!(tmp = chck_realloc_mul_of(decompressed, bsize, 2)))
-         goto fail;
-
-      decompressed = tmp;
-      dsize = (bsize *= 2);
-   }
+   z_stream stream;
+   memset(&stream, 0, sizeof(stream));
+   if (inflateInit(&stream) != Z_OK)
+      goto fail;
 
-   if (unlikely(ret != Z_OK))
+   // inflate incrementally, so growing the output doesn't start decompression over
+   int ret = Z_BUF_ERROR;
+   size_t in = 0;
+   do {
+      if (!stream.avail_in && in < buf->size) {
+         const size_t chunk = (buf->size - in > UINT_MAX ? UINT_MAX : buf->size - in);
+         stream.next_in = buf->buffer + in;
+         stream.avail_in = chunk;
+         in += chunk;
+      }
+
+      if (dsize == bsize) {
+         void *tmp;
+         if (!(tmp = chck_realloc_mul_of(decompressed, bsize, 2)))
+            break;
+
+         decompressed = tmp;
+         bsize *= 2;
+      }
+
+      const size_t space = (bsize - dsize > UINT_MAX ? UINT_MAX : bsize - dsize);
+      stream.next_out = decompressed + dsize;
+      stream.avail_out = space;
+      ret = inflate(&stream, Z_NO_FLUSH);
+      dsize += space - stream.avail_out;
+   } while (ret == Z_OK);
+
+   inflateEnd(&stream);
+
+   if (unlikely(ret != Z_STREAM_END))
       goto fail;
 
    chck_buffer_set_pointer(buf, decompressed, bsize, buf->endianess);
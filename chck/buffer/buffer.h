@@ -15,6 +15,21 @@ enum chck_bits {
    CHCK_BUFFER_B64 = sizeof(int64_t),
 };
 
+enum chck_buffer_map {
+   // map read only, writing to the buffer without resizing it first is undefined
+   CHCK_BUFFER_MAP_READ = 0,
+
+   // map read-write, writes within the file size go straight to the file
+   CHCK_BUFFER_MAP_WRITE = 1<<0,
+
+   // prefault the whole file on map (MAP_POPULATE)
+   CHCK_BUFFER_MAP_POPULATE = 1<<1,
+
+   // access pattern hints for the kernel (madvise)
+   CHCK_BUFFER_MAP_SEQUENTIAL = 1<<2,
+   CHCK_BUFFER_MAP_RANDOM = 1<<3,
+};
+
 struct chck_buffer {
    // pointer to current buffer and the current position
    void *buffer, *curpos;
@@ -22,14 +37,24 @@ struct chck_buffer {
    // size of the buffer
    size_t size;
 
-   // growth step for the buffer incase writing to full buffer
+   // minimum growth step for the buffer incase writing to full buffer
    size_t step;
 
+   // upper bound for a single growth, 0 == unbounded
+   size_t max_step;
+
+   // full buffer grows by (growth - 1) times its size, 0 or 1 grows only by step
+   unsigned int growth;
+
    // endianess true == big, false == little
    bool endianess;
 
    // copied == true, means that buffer is owned by this struct and will be freed on chck_buffer_release
    bool copied;
+
+   // mapped == true, means that buffer is a file mapping owned by this struct and will be unmapped on chck_buffer_release
+   // resizing a mapped buffer moves the contents to heap memory, after which writes no longer reach the file
+   bool mapped;
 };
 
 CHCK_NONULL static inline bool
@@ -42,6 +67,7 @@ void chck_buffer_release(struct chck_buffer *buf);
 CHCK_NONULL void chck_buffer_flush(struct chck_buffer *buf);
 CHCK_NONULLV(1) bool chck_buffer_from_pointer(struct chck_buffer *buf, void *ptr, size_t size, enum chck_endianess endianess);
 CHCK_NONULL bool chck_buffer(struct chck_buffer *buf, size_t size, enum chck_endianess endianess);
+CHCK_NONULL bool chck_buffer_map_file(struct chck_buffer *buf, const char *path, enum chck_buffer_map mode, enum chck_endianess endianess);
 CHCK_NONULLV(1) void chck_buffer_set_pointer(struct chck_buffer *buf, void *ptr, size_t size, enum chck_endianess endianess);
 
 CHCK_NONULL size_t chck_buffer_fill(const void *src, size_t size, size_t memb, struct chck_buffer *buf);
@@ -66,6 +92,8 @@ CHCK_NONULL size_t chck_buffer_write_varg(struct chck_buffer *buf, const char *f
 
 CHCK_NONULL ptrdiff_t chck_buffer_seek(struct chck_buffer *buf, long offset, int whence);
 CHCK_NONULL bool chck_buffer_resize(struct chck_buffer *buf, size_t size);
+CHCK_NONULL bool chck_buffer_reserve(struct chck_buffer *buf, size_t size);
+CHCK_NONULL void chck_buffer_set_growth(struct chck_buffer *buf, size_t step, unsigned int growth, size_t max_step);
 
 /* -DHAS_ZLIB=1 -lz */
 CHCK_NONULL bool chck_buffer_compress_zlib(struct chck_buffer *buf);
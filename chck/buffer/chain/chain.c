@@ -0,0 +1,280 @@
+#include "chain.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+// segments handed to a single writev/sendmsg
+#if defined(IOV_MAX) && IOV_MAX < 64
+#  define MAX_IOV IOV_MAX
+#else
+#  define MAX_IOV 64
+#endif
+
+static inline size_t
+used(const struct chck_buffer_segment *segment)
+{
+   assert(segment);
+   return segment->buffer.curpos - segment->buffer.buffer;
+}
+
+static struct chck_buffer_segment*
+add_segment(struct chck_buffer_chain *chain)
+{
+   assert(chain);
+
+   if (chain->count >= chain->allocated) {
+      const size_t allocated = (chain->allocated ? chain->allocated * 2 : 4);
+
+      size_t sz;
+      if (unlikely(chck_mul_ofsz(allocated, sizeof(struct chck_buffer_segment), &sz)))
+         return NULL;
+
+      void *tmp;
+      if (!(tmp = realloc(chain->segments, sz)))
+         return NULL;
+
+      chain->segments = tmp;
+      chain->allocated = allocated;
+   }
+
+   struct chck_buffer_segment *segment = &chain->segments[chain->count++];
+   memset(segment, 0, sizeof(struct chck_buffer_segment));
+   return segment;
+}
+
+static void
+consume(struct chck_buffer_chain *chain, size_t bytes)
+{
+   assert(chain);
+
+   size_t i;
+   for (i = 0; i < chain->count; ++i) {
+      const size_t left = used(&chain->segments[i]) - chain->offset;
+      if (bytes < left) {
+         chain->offset += bytes;
+         break;
+      }
+
+      bytes -= left;
+      chain->offset = 0;
+      chck_buffer_release(&chain->segments[i].buffer);
+   }
+
+   if (i > 0) {
+      memmove(chain->segments, chain->segments + i, (chain->count - i) * sizeof(struct chck_buffer_segment));
+      chain->count -= i;
+   }
+}
+
+static ssize_t
+write_out(struct chck_buffer_chain *chain, int fd, int flags, bool msg)
+{
+   assert(chain);
+
+   size_t wrote = 0;
+   while (chain->count > 0) {
+      struct iovec iov[MAX_IOV];
+      size_t n = 0, want = 0;
+      for (size_t i = 0; i < chain->count && n < MAX_IOV; ++i) {
+         const size_t skip = (i == 0 ? chain->offset : 0);
+         const size_t len = used(&chain->segments[i]) - skip;
+
+         if (!len)
+            continue;
+
+         iov[n].iov_base = chain->segments[i].buffer.buffer + skip;
+         iov[n++].iov_len = len;
+         want += len;
+      }
+
+      // only empty segments left
+      if (!n) {
+         consume(chain, 0);
+         break;
+      }
+
+      ssize_t ret;
+      if (msg) {
+         struct msghdr hdr;
+         memset(&hdr, 0, sizeof(hdr));
+         hdr.msg_iov = iov;
+         hdr.msg_iovlen = n;
+         ret = sendmsg(fd, &hdr, flags);
+      } else {
+         ret = writev(fd, iov, n);
+      }
+
+      if (ret < 0 && errno == EINTR)
+         continue;
+
+      if (ret < 0)
+         return (wrote > 0 ? (ssize_t)wrote : -1);
+
+      consume(chain, ret);
+      wrote += ret;
+
+      // fd is full, try again later
+      if ((size_t)ret < want)
+         break;
+   }
+
+   return wrote;
+}
+
+void
+chck_buffer_chain_release(struct chck_buffer_chain *chain)
+{
+   if (!chain)
+      return;
+
+   for (size_t i = 0; i < chain->count; ++i)
+      chck_buffer_release(&chain->segments[i].buffer);
+
+   free(chain->segments);
+   memset(chain, 0, sizeof(struct chck_buffer_chain));
+}
+
+bool
+chck_buffer_chain(struct chck_buffer_chain *chain, size_t step, enum chck_endianess endianess)
+{
+   assert(chain && step > 0);
+   memset(chain, 0, sizeof(struct chck_buffer_chain));
+
+   if (unlikely(!step))
+      return false;
+
+   chain->step = step;
+   chain->endianess = endianess;
+   return true;
+}
+
+struct chck_buffer*
+chck_buffer_chain_tail(struct chck_buffer_chain *chain)
+{
+   assert(chain);
+
+   if (chain->count > 0 && !chain->segments[chain->count - 1].sealed)
+      return &chain->segments[chain->count - 1].buffer;
+
+   struct chck_buffer_segment *segment;
+   if (!(segment = add_segment(chain)))
+      return NULL;
+
+   if (!chck_buffer(&segment->buffer, chain->step, chain->endianess)) {
+      --chain->count;
+      return NULL;
+   }
+
+   return &segment->buffer;
+}
+
+bool
+chck_buffer_chain_append(struct chck_buffer_chain *chain, const void *data, size_t size)
+{
+   assert(chain && (data || !size));
+
+   if (!size)
+      return true;
+
+   if (unlikely(!data))
+      return false;
+
+   struct chck_buffer_segment *segment;
+   if (!(segment = add_segment(chain)))
+      return false;
+
+   // chain never writes to sealed segment, so casting the const away is fine
+   chck_buffer_from_pointer(&segment->buffer, (void*)data, size, chain->endianess);
+   chck_buffer_seek(&segment->buffer, 0, SEEK_END);
+   segment->sealed = true;
+   return true;
+}
+
+bool
+chck_buffer_chain_append_buffer(struct chck_buffer_chain *chain, struct chck_buffer *buf)
+{
+   assert(chain && buf);
+
+   struct chck_buffer_segment *segment;
+   if (!(segment = add_segment(chain)))
+      return false;
+
+   // writing to it could resize it, which copies mapping to heap, or loses memory the buffer doesn't own
+   segment->buffer = *buf;
+   segment->sealed = true;
+   memset(buf, 0, sizeof(struct chck_buffer));
+
+   // mapping is the file, not something written up to curpos
+   if (segment->buffer.mapped)
+      chck_buffer_seek(&segment->buffer, 0, SEEK_END);
+   return true;
+}
+
+size_t
+chck_buffer_chain_size(const struct chck_buffer_chain *chain)
+{
+   assert(chain);
+
+   size_t size = 0;
+   for (size_t i = 0; i < chain->count; ++i)
+      size += used(&chain->segments[i]);
+
+   return size - chain->offset;
+}
+
+size_t
+chck_buffer_chain_write(const void *src, size_t size, size_t nmemb, struct chck_buffer_chain *chain)
+{
+   struct chck_buffer *buf;
+   if (!(buf = chck_buffer_chain_tail(chain)))
+      return 0;
+
+   return chck_buffer_write(src, size, nmemb, buf);
+}
+
+bool
+chck_buffer_chain_write_int(const void *i, enum chck_bits bits, struct chck_buffer_chain *chain)
+{
+   struct chck_buffer *buf;
+   if (!(buf = chck_buffer_chain_tail(chain)))
+      return false;
+
+   return chck_buffer_write_int(i, bits, buf);
+}
+
+bool
+chck_buffer_chain_write_string(const char *str, size_t len, struct chck_buffer_chain *chain)
+{
+   struct chck_buffer *buf;
+   if (!(buf = chck_buffer_chain_tail(chain)))
+      return false;
+
+   return chck_buffer_write_string(str, len, buf);
+}
+
+bool
+chck_buffer_chain_write_string_of_type(const char *str, size_t len, enum chck_bits bits, struct chck_buffer_chain *chain)
+{
+   struct chck_buffer *buf;
+   if (!(buf = chck_buffer_chain_tail(chain)))
+      return false;
+
+   return chck_buffer_write_string_of_type(str, len, bits, buf);
+}
+
+ssize_t
+chck_buffer_chain_writev(struct chck_buffer_chain *chain, int fd)
+{
+   return write_out(chain, fd, 0, false);
+}
+
+ssize_t
+chck_buffer_chain_sendmsg(struct chck_buffer_chain *chain, int fd, int flags)
+{
+   return write_out(chain, fd, flags, true);
+}
@@ -0,0 +1,62 @@
+#ifndef __chck_buffer_chain__
+#define __chck_buffer_chain__
+
+#include <chck/macros.h>
+#include <chck/buffer/buffer.h>
+#include <sys/types.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct chck_buffer_segment {
+   // contents of the segment are the bytes before curpos
+   struct chck_buffer buffer;
+
+   // sealed == true, means that chain never writes into the segment (appended data and buffers)
+   // it's still released with chck_buffer_release, which frees only the memory the buffer owns
+   bool sealed;
+};
+
+struct chck_buffer_chain {
+   struct chck_buffer_segment *segments;
+   size_t count, allocated;
+
+   // bytes of the first segment already written out
+   size_t offset;
+
+   // initial size of owned segments created for writing
+   size_t step;
+
+   enum chck_endianess endianess;
+};
+
+/**
+ * Scatter-gather list of chck_buffers, for framing large payloads without copying them.
+ * Writes through the chain go to the owned tail segment, which is created with step bytes when the chain is empty or ends with sealed segment.
+ * chck_buffer_chain_append adds sealed segment that only points to caller's memory, which must stay valid until the segment has been written out.
+ * chck_buffer_chain_append_buffer moves the buffer into the chain as sealed segment, and leaves buf released. Its contents are the bytes before curpos,
+ * except for mapped buffer (chck_buffer_map_file), which is appended whole. The chain frees or unmaps the buffer once it's written out.
+ *
+ * chck_buffer_chain_tail returns the owned tail segment, so rest of the chck_buffer_write_* API can be used with the chain.
+ * The pointer is valid until the next append or write out.
+ *
+ * chck_buffer_chain_writev and chck_buffer_chain_sendmsg write the segments out as one iovec without flattening them.
+ * Fully written segments are released, partial writes (non-blocking fds) are remembered, so calling them again continues from there.
+ * They return the bytes written, or -1 if nothing was written because of error (errno is set).
+ */
+
+CHCK_NONULL bool chck_buffer_chain(struct chck_buffer_chain *chain, size_t step, enum chck_endianess endianess);
+void chck_buffer_chain_release(struct chck_buffer_chain *chain);
+CHCK_NONULL struct chck_buffer* chck_buffer_chain_tail(struct chck_buffer_chain *chain);
+CHCK_NONULLV(1) bool chck_buffer_chain_append(struct chck_buffer_chain *chain, const void *data, size_t size);
+CHCK_NONULL bool chck_buffer_chain_append_buffer(struct chck_buffer_chain *chain, struct chck_buffer *buf);
+CHCK_NONULL size_t chck_buffer_chain_size(const struct chck_buffer_chain *chain);
+
+CHCK_NONULL size_t chck_buffer_chain_write(const void *src, size_t size, size_t nmemb, struct chck_buffer_chain *chain);
+CHCK_NONULL bool chck_buffer_chain_write_int(const void *i, enum chck_bits bits, struct chck_buffer_chain *chain);
+CHCK_NONULL bool chck_buffer_chain_write_string(const char *str, size_t len, struct chck_buffer_chain *chain);
+CHCK_NONULL bool chck_buffer_chain_write_string_of_type(const char *str, size_t len, enum chck_bits bits, struct chck_buffer_chain *chain);
+
+CHCK_NONULL ssize_t chck_buffer_chain_writev(struct chck_buffer_chain *chain, int fd);
+CHCK_NONULL ssize_t chck_buffer_chain_sendmsg(struct chck_buffer_chain *chain, int fd, int flags);
+
+#endif /* __chck_buffer_chain__ */
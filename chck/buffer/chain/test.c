@@ -0,0 +1,184 @@
+#include "chain.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#define BLOB_SIZE (1024 * 1024)
+
+static size_t
+drain(int fd, uint8_t *dst, size_t size)
+{
+   size_t got = 0;
+   ssize_t ret;
+   while (got < size && (ret = read(fd, dst + got, size - got)) > 0)
+      got += ret;
+   return got;
+}
+
+int main(void)
+{
+   /* TEST: framing with sealed and owned segments */
+   {
+      uint8_t *blob;
+      assert((blob = malloc(BLOB_SIZE)));
+      for (size_t i = 0; i < BLOB_SIZE; ++i)
+         blob[i] = i * 7;
+
+      struct chck_buffer_chain chain;
+      assert(chck_buffer_chain(&chain, 16, CHCK_ENDIANESS_LITTLE));
+      assert(chck_buffer_chain_size(&chain) == 0);
+
+      const uint32_t size = BLOB_SIZE;
+      assert(chck_buffer_chain_write_int(&size, sizeof(size), &chain));
+      assert(chck_buffer_chain_write_string("blob", 4, &chain));
+      assert(chck_buffer_chain_append(&chain, blob, BLOB_SIZE));
+      assert(chck_buffer_chain_append(&chain, NULL, 0));
+
+      struct chck_buffer buf;
+      assert(chck_buffer(&buf, 8, CHCK_ENDIANESS_LITTLE));
+      assert(chck_buffer_write_string("owned", 5, &buf));
+      assert(chck_buffer_chain_append_buffer(&chain, &buf));
+      assert(!buf.buffer);
+
+      // goes to new tail after the moved in buffer
+      const uint16_t trailer = 0xBEEF;
+      assert(chck_buffer_chain_write_int(&trailer, sizeof(trailer), &chain));
+      assert(chain.count == 4 && chain.segments[2].sealed && !chain.segments[3].sealed);
+
+      const size_t total = 4 + 6 + BLOB_SIZE + 7 + 2;
+      assert(chck_buffer_chain_size(&chain) == total);
+
+      // blob is not copied
+      assert(chain.segments[1].sealed && chain.segments[1].buffer.buffer == blob);
+
+      char path[] = "/tmp/chck_chain_XXXXXX";
+      int fd;
+      assert((fd = mkstemp(path)) >= 0);
+      unlink(path);
+
+      assert(chck_buffer_chain_writev(&chain, fd) == (ssize_t)total);
+      assert(chain.count == 0 && chck_buffer_chain_size(&chain) == 0);
+      assert(chck_buffer_chain_writev(&chain, fd) == 0);
+
+      uint8_t *check;
+      assert((check = malloc(total)));
+      assert(pread(fd, check, total, 0) == (ssize_t)total);
+      assert(!memcmp(check, "\x00\x00\x10\x00\x01\x04" "blob", 10));
+      assert(!memcmp(check + 10, blob, BLOB_SIZE));
+      assert(!memcmp(check + 10 + BLOB_SIZE, "\x01\x05" "owned" "\xEF\xBE", 9));
+      close(fd);
+
+      /* TEST: partial writes over non-blocking socket */
+      int sv[2];
+      assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+      assert(fcntl(sv[0], F_SETFL, O_NONBLOCK) == 0);
+
+      assert(chck_buffer_chain_write_int(&size, sizeof(size), &chain));
+      assert(chck_buffer_chain_write_string("blob", 4, &chain));
+      assert(chck_buffer_chain_append(&chain, blob, BLOB_SIZE));
+      assert(chck_buffer_chain_write_string("owned", 5, &chain));
+      assert(chck_buffer_chain_write_int(&trailer, sizeof(trailer), &chain));
+      assert(chck_buffer_chain_size(&chain) == total);
+
+      size_t sent = 0, got = 0, rounds = 0;
+      memset(check, 0, total);
+      for (; chck_buffer_chain_size(&chain) > 0; ++rounds) {
+         const ssize_t ret = chck_buffer_chain_sendmsg(&chain, sv[0], MSG_NOSIGNAL);
+         assert(ret >= 0 || errno == EAGAIN);
+         sent += (ret > 0 ? ret : 0);
+         assert(chck_buffer_chain_size(&chain) == total - sent);
+
+         uint8_t tmp[65536];
+         const size_t want = (sent - got < sizeof(tmp) ? sent - got : sizeof(tmp));
+         memcpy(check + got, tmp, drain(sv[1], tmp, want));
+         got += want;
+      }
+      got += drain(sv[1], check + got, total - got);
+      assert(sent == total && got == total && rounds > 1);
+
+      assert(!memcmp(check, "\x00\x00\x10\x00\x01\x04" "blob", 10));
+      assert(!memcmp(check + 10, blob, BLOB_SIZE));
+      assert(!memcmp(check + 10 + BLOB_SIZE, "\x01\x05" "owned" "\xEF\xBE", 9));
+
+      close(sv[0]);
+      close(sv[1]);
+      free(check);
+
+      // moved in buffer that doesn't own its memory is not written into
+      uint8_t stack[4] = { 1, 2, 3, 4 };
+      assert(chck_buffer_from_pointer(&buf, stack, sizeof(stack), CHCK_ENDIANESS_LITTLE));
+      chck_buffer_seek(&buf, 0, SEEK_END);
+      assert(chck_buffer_chain_append_buffer(&chain, &buf));
+      assert(chain.segments[chain.count - 1].sealed);
+      assert(chck_buffer_chain_write_int(&trailer, sizeof(trailer), &chain));
+      assert(chain.segments[chain.count - 1].buffer.buffer != stack);
+      assert(!memcmp(stack, "\x01\x02\x03\x04", 4));
+      assert(chck_buffer_chain_size(&chain) == sizeof(stack) + sizeof(trailer));
+
+      // release frees owned segments that were never written
+      assert(chck_buffer_chain_write_string("leftover", 8, &chain));
+      assert(chck_buffer_chain_append(&chain, blob, 16));
+      chck_buffer_chain_release(&chain);
+      free(blob);
+   }
+
+   /* TEST: mapped blob between header and trailer */
+   {
+      uint8_t *blob;
+      assert((blob = malloc(BLOB_SIZE)));
+      for (size_t i = 0; i < BLOB_SIZE; ++i)
+         blob[i] = i * 13;
+
+      char path[] = "/tmp/chck_chain_XXXXXX";
+      int fd;
+      assert((fd = mkstemp(path)) >= 0);
+      assert(write(fd, blob, BLOB_SIZE) == BLOB_SIZE);
+      close(fd);
+
+      struct chck_buffer buf;
+      assert(chck_buffer_map_file(&buf, path, CHCK_BUFFER_MAP_READ, CHCK_ENDIANESS_LITTLE));
+      unlink(path);
+      const void *mapping = buf.buffer;
+
+      struct chck_buffer_chain chain;
+      assert(chck_buffer_chain(&chain, 16, CHCK_ENDIANESS_LITTLE));
+
+      const uint32_t header = BLOB_SIZE;
+      assert(chck_buffer_chain_write_int(&header, sizeof(header), &chain));
+      assert(chck_buffer_chain_append_buffer(&chain, &buf));
+
+      // trailer does not touch the mapping, and the mapping is sent whole
+      const uint32_t trailer = 0xCAFEBABE;
+      assert(chck_buffer_chain_write_int(&trailer, sizeof(trailer), &chain));
+      assert(chain.count == 3);
+      assert(chain.segments[1].buffer.mapped && chain.segments[1].buffer.buffer == mapping && chain.segments[1].buffer.size == BLOB_SIZE);
+      assert(chck_buffer_chain_size(&chain) == 4 + BLOB_SIZE + 4);
+
+      char out[] = "/tmp/chck_chain_XXXXXX";
+      assert((fd = mkstemp(out)) >= 0);
+      unlink(out);
+      assert(chck_buffer_chain_writev(&chain, fd) == 4 + BLOB_SIZE + 4);
+      assert(chain.count == 0);
+
+      uint8_t *check;
+      assert((check = malloc(4 + BLOB_SIZE + 4)));
+      assert(pread(fd, check, 4 + BLOB_SIZE + 4, 0) == 4 + BLOB_SIZE + 4);
+      assert(!memcmp(check, "\x00\x00\x10\x00", 4));
+      assert(!memcmp(check + 4, blob, BLOB_SIZE));
+      assert(!memcmp(check + 4 + BLOB_SIZE, "\xBE\xBA\xFE\xCA", 4));
+      close(fd);
+
+      chck_buffer_chain_release(&chain);
+      free(check);
+      free(blob);
+   }
+
+   return EXIT_SUCCESS;
+}
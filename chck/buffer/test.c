@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #undef NDEBUG
 #include <assert.h>
@@ -131,6 +133,111 @@ int main(void)
       }
    }
 
+   /* TEST: growth && reserve */
+   {
+      struct chck_buffer buf;
+      assert(chck_buffer(&buf, 1, CHCK_ENDIANESS_NATIVE));
+
+      // geometric growth, amount of resizes is logarithmic
+      size_t resizes = 0, last = buf.size;
+      for (uint32_t i = 0; i < 0x40000; ++i) {
+         assert(chck_buffer_write_int(&i, sizeof(i), &buf));
+         if (buf.size != last) {
+            assert(buf.size >= last * 2);
+            last = buf.size;
+            ++resizes;
+         }
+      }
+      assert(resizes < 32);
+
+      // capped growth
+      chck_buffer_set_growth(&buf, 32, 2, 4096);
+      chck_buffer_seek(&buf, 0, SEEK_END);
+      last = buf.size;
+      assert(chck_buffer_write_int(&last, sizeof(last), &buf));
+      assert(buf.size == last + 4096);
+
+      // linear growth, writes bigger than step still fit
+      chck_buffer_set_growth(&buf, 32, 0, 0);
+      chck_buffer_seek(&buf, 0, SEEK_END);
+      last = buf.size;
+      char blob[64] = {0};
+      assert(chck_buffer_write(blob, 1, sizeof(blob), &buf) == sizeof(blob));
+      assert(buf.size == last + sizeof(blob));
+      assert(chck_buffer_write(blob, 1, 8, &buf) == 8);
+      assert(buf.size == last + sizeof(blob) + 32);
+
+      // reserve makes room only once
+      chck_buffer_seek(&buf, 0, SEEK_END);
+      assert(chck_buffer_reserve(&buf, 1000));
+      assert(buf.size - (buf.curpos - buf.buffer) == 1000);
+      last = buf.size;
+      const void *ptr = buf.buffer;
+      assert(chck_buffer_reserve(&buf, 10));
+      for (uint32_t i = 0; i < 1000 / sizeof(i); ++i)
+         assert(chck_buffer_write_int(&i, sizeof(i), &buf));
+      assert(buf.size == last && buf.buffer == ptr);
+
+      chck_buffer_seek(&buf, 0, SEEK_SET);
+      for (uint32_t t, i = 0; i < 0x40000; ++i) { assert(chck_buffer_read_int(&t, sizeof(t), &buf)); assert(i == t); }
+      chck_buffer_release(&buf);
+   }
+
+   /* TEST: file mapping */
+   {
+      char path[] = "/tmp/chck-buffer-XXXXXX";
+      const int fd = mkstemp(path);
+      assert(fd >= 0);
+
+      struct chck_buffer buf;
+      assert(chck_buffer_map_file(&buf, path, CHCK_BUFFER_MAP_READ, CHCK_ENDIANESS_LITTLE));
+      assert(!buf.mapped && !buf.buffer && buf.size == 0);
+      chck_buffer_release(&buf);
+
+      const uint8_t data[] = { 0x04, 0x00, 0x00, 0x00, 't', 'e', 's', 't', 0x01, 0x02 };
+      assert(write(fd, data, sizeof(data)) == sizeof(data));
+
+      assert(chck_buffer_map_file(&buf, path, CHCK_BUFFER_MAP_READ | CHCK_BUFFER_MAP_POPULATE | CHCK_BUFFER_MAP_SEQUENTIAL, CHCK_ENDIANESS_LITTLE));
+      assert(buf.mapped && !buf.copied && buf.size == sizeof(data));
+
+      char *str;
+      size_t len;
+      assert(chck_buffer_read_string_of_type(&str, &len, CHCK_BUFFER_B32, &buf));
+      assert(len == 4 && !strcmp(str, "test"));
+      free(str);
+
+      uint16_t s;
+      assert(chck_buffer_read_int(&s, sizeof(s), &buf));
+      assert(s == 0x0201);
+      assert(!chck_buffer_read_int(&s, sizeof(s), &buf));
+
+      assert(chck_buffer_seek(&buf, 4, SEEK_SET) == 4);
+      uint8_t c;
+      assert(chck_buffer_read_int(&c, sizeof(c), &buf) && c == 't');
+      chck_buffer_release(&buf);
+
+      // writes within the file go to the file
+      assert(chck_buffer_map_file(&buf, path, CHCK_BUFFER_MAP_WRITE | CHCK_BUFFER_MAP_RANDOM, CHCK_ENDIANESS_LITTLE));
+      chck_buffer_seek(&buf, 8, SEEK_SET);
+      s = 0x0403;
+      assert(chck_buffer_write_int(&s, sizeof(s), &buf));
+      assert(buf.mapped);
+
+      // writes past the end move the buffer to heap
+      assert(chck_buffer_write_int(&s, sizeof(s), &buf));
+      assert(!buf.mapped && buf.copied);
+      assert(memcmp(buf.buffer, "\x04\0\0\0test\x03\x04\x03\x04", 12) == 0);
+      chck_buffer_release(&buf);
+
+      uint8_t check[sizeof(data) + 1];
+      assert(pread(fd, check, sizeof(check), 0) == sizeof(data));
+      assert(check[8] == 0x03 && check[9] == 0x04);
+
+      close(fd);
+      unlink(path);
+      assert(!chck_buffer_map_file(&buf, path, CHCK_BUFFER_MAP_READ, CHCK_ENDIANESS_NATIVE));
+   }
+
    /* TEST: zlib compression && decompression */
    {
       char uncompressed[] = ".....................";
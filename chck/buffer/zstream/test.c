@@ -0,0 +1,140 @@
+#include "zstream.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#define DATA_SIZE (4 * 1024 * 1024)
+
+int main(void)
+{
+   // compresses well, but not to nothing
+   uint8_t *data;
+   assert((data = malloc(DATA_SIZE)));
+   for (size_t i = 0; i < DATA_SIZE; ++i)
+      data[i] = (i % 251 < 16 ? i * 31 : 'a');
+
+   /* TEST: deflate in chunks && inflate in chunks */
+   struct chck_buffer compressed;
+   {
+      struct chck_zstream zs;
+      assert(chck_zstream_deflate(&zs, Z_DEFAULT_COMPRESSION, 0));
+      assert(chck_buffer_from_pointer(&compressed, NULL, 0, CHCK_ENDIANESS_NATIVE));
+
+      for (size_t off = 0; off < DATA_SIZE; off += 1000)
+         assert(chck_zstream_write(&zs, data + off, (DATA_SIZE - off < 1000 ? DATA_SIZE - off : 1000), &compressed));
+
+      assert(chck_zstream_finish(&zs, &compressed));
+      chck_zstream_release(&zs);
+
+      const size_t csize = compressed.curpos - compressed.buffer;
+      assert(csize > 0 && csize < DATA_SIZE / 10);
+
+      struct chck_buffer out;
+      assert(chck_buffer_from_pointer(&out, NULL, 0, CHCK_ENDIANESS_NATIVE));
+      assert(chck_zstream_inflate(&zs, 0));
+      for (size_t off = 0; off < csize; off += 333)
+         assert(chck_zstream_write(&zs, compressed.buffer + off, (csize - off < 333 ? csize - off : 333), &out));
+      assert(chck_zstream_finish(&zs, &out));
+      chck_zstream_release(&zs);
+
+      assert((size_t)(out.curpos - out.buffer) == DATA_SIZE);
+      assert(!memcmp(out.buffer, data, DATA_SIZE));
+      chck_buffer_release(&out);
+   }
+
+   /* TEST: known size, output is reserved once */
+   {
+      const size_t csize = compressed.curpos - compressed.buffer;
+
+      struct chck_zstream zs;
+      struct chck_buffer out;
+      assert(chck_buffer_from_pointer(&out, NULL, 0, CHCK_ENDIANESS_NATIVE));
+      assert(chck_zstream_inflate(&zs, DATA_SIZE));
+
+      // feed it so the stream trailer arrives separately after output is full
+      assert(chck_zstream_write(&zs, compressed.buffer, csize - 2, &out));
+      const void *ptr = out.buffer;
+      assert(out.size == DATA_SIZE);
+      assert(chck_zstream_write(&zs, compressed.buffer + csize - 2, 2, &out));
+      assert(chck_zstream_finish(&zs, &out));
+      chck_zstream_release(&zs);
+
+      assert(out.buffer == ptr && out.size == DATA_SIZE);
+      assert((size_t)(out.curpos - out.buffer) == DATA_SIZE);
+      assert(!memcmp(out.buffer, data, DATA_SIZE));
+      chck_buffer_release(&out);
+
+      // deflate with known size lands in deflateBound sized buffer
+      assert(chck_zstream_deflate(&zs, Z_BEST_SPEED, DATA_SIZE));
+      assert(chck_buffer_from_pointer(&out, NULL, 0, CHCK_ENDIANESS_NATIVE));
+      assert(chck_zstream_write(&zs, data, DATA_SIZE, &out));
+      const size_t size = out.size;
+      assert(chck_zstream_finish(&zs, &out));
+      assert(out.size == size);
+      chck_zstream_release(&zs);
+      chck_buffer_release(&out);
+   }
+
+   /* TEST: fd && FILE sources */
+   {
+      const size_t csize = compressed.curpos - compressed.buffer;
+
+      char path[] = "/tmp/chck_zstream_XXXXXX";
+      int fd;
+      assert((fd = mkstemp(path)) >= 0);
+      unlink(path);
+      assert(write(fd, compressed.buffer, csize) == (ssize_t)csize);
+
+      struct chck_zstream zs;
+      struct chck_buffer out;
+      assert(chck_buffer_from_pointer(&out, NULL, 0, CHCK_ENDIANESS_NATIVE));
+      assert(chck_zstream_inflate(&zs, 0));
+      assert(lseek(fd, 0, SEEK_SET) == 0);
+      assert(chck_zstream_write_from_fd(&zs, fd, 0, &out));
+      assert(chck_zstream_finish(&zs, &out));
+      chck_zstream_release(&zs);
+      assert((size_t)(out.curpos - out.buffer) == DATA_SIZE && !memcmp(out.buffer, data, DATA_SIZE));
+
+      FILE *f;
+      assert((f = fdopen(fd, "rb")));
+      rewind(f);
+      chck_buffer_seek(&out, 0, SEEK_SET);
+      assert(chck_zstream_inflate(&zs, DATA_SIZE));
+      assert(chck_zstream_write_from_file(&zs, f, csize, &out));
+      assert(chck_zstream_finish(&zs, &out));
+      chck_zstream_release(&zs);
+      assert((size_t)(out.curpos - out.buffer) == DATA_SIZE && !memcmp(out.buffer, data, DATA_SIZE));
+      fclose(f);
+
+      // truncated stream
+      assert(chck_zstream_inflate(&zs, 0));
+      chck_buffer_seek(&out, 0, SEEK_SET);
+      assert(chck_zstream_write(&zs, compressed.buffer, csize / 2, &out));
+      assert(!chck_zstream_finish(&zs, &out));
+      chck_zstream_release(&zs);
+
+      // garbage after the stream
+      const uint8_t garbage[] = { 1, 2, 3 };
+      assert(chck_zstream_inflate(&zs, 0));
+      assert(chck_zstream_write(&zs, compressed.buffer, csize, &out));
+      assert(!chck_zstream_write(&zs, garbage, sizeof(garbage), &out));
+      chck_zstream_release(&zs);
+      chck_buffer_release(&out);
+   }
+
+   /* TEST: chck_buffer_decompress_zlib with high ratio */
+   {
+      const size_t csize = compressed.curpos - compressed.buffer;
+      assert(chck_buffer_resize(&compressed, csize));
+      assert(chck_buffer_decompress_zlib(&compressed));
+      assert(compressed.size == DATA_SIZE && !memcmp(compressed.buffer, data, DATA_SIZE));
+   }
+
+   chck_buffer_release(&compressed);
+   free(data);
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+#include "zstream.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+// size of input chunks read from fd or FILE, and least amount of output space to grow by
+#define CHUNK 16384
+
+static bool
+make_room(struct chck_zstream *zs, bool grow, struct chck_buffer *out)
+{
+   assert(zs && out);
+
+   size_t want;
+   if (zs->hint > 0) {
+      want = zs->hint;
+      zs->hint = 0;
+   } else if (grow) {
+      want = (out->size > CHUNK ? out->size : CHUNK);
+   } else {
+      return true;
+   }
+
+   const size_t space = out->size - (out->curpos - out->buffer);
+   return (space >= want || chck_buffer_reserve(out, want));
+}
+
+static bool
+run(struct chck_zstream *zs, int flush, struct chck_buffer *out)
+{
+   assert(zs && out);
+
+   if (zs->done)
+      return (zs->stream.avail_in == 0);
+
+   // zlib refuses NULL output even when there is no room
+   bool grow = !out->buffer;
+
+   while (true) {
+      if (!make_room(zs, grow, out))
+         return false;
+
+      const size_t left = out->size - (out->curpos - out->buffer);
+      const uInt space = (left > UINT_MAX ? UINT_MAX : left);
+      zs->stream.next_out = out->curpos;
+      zs->stream.avail_out = space;
+
+      const int ret = (zs->deflate ? deflate(&zs->stream, flush) : inflate(&zs->stream, Z_NO_FLUSH));
+      out->curpos += space - zs->stream.avail_out;
+
+      if (ret == Z_STREAM_END) {
+         zs->done = true;
+         return (zs->stream.avail_in == 0);
+      }
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+         return false;
+
+      // all input consumed, anything zlib still holds comes out on next write or finish
+      if (zs->stream.avail_in == 0 && flush != Z_FINISH)
+         return true;
+
+      // no progress with room to spare, stream is truncated
+      if (ret == Z_BUF_ERROR && zs->stream.avail_out > 0)
+         return false;
+
+      // out of room, but zlib may still progress without output (e.g. stream trailer), so grow only once it can't
+      grow = (ret == Z_BUF_ERROR);
+   }
+}
+
+void
+chck_zstream_release(struct chck_zstream *zs)
+{
+   if (!zs)
+      return;
+
+   if (zs->deflate) {
+      deflateEnd(&zs->stream);
+   } else {
+      inflateEnd(&zs->stream);
+   }
+
+   memset(zs, 0, sizeof(struct chck_zstream));
+}
+
+bool
+chck_zstream_deflate(struct chck_zstream *zs, int level, size_t size)
+{
+   assert(zs);
+   memset(zs, 0, sizeof(struct chck_zstream));
+
+   if (deflateInit(&zs->stream, level) != Z_OK)
+      return false;
+
+   // deflateBound takes uLong
+   if (size > 0 && size <= ULONG_MAX)
+      zs->hint = deflateBound(&zs->stream, size);
+
+   zs->deflate = true;
+   return true;
+}
+
+bool
+chck_zstream_inflate(struct chck_zstream *zs, size_t size)
+{
+   assert(zs);
+   memset(zs, 0, sizeof(struct chck_zstream));
+
+   if (inflateInit(&zs->stream) != Z_OK)
+      return false;
+
+   zs->hint = size;
+   return true;
+}
+
+bool
+chck_zstream_write(struct chck_zstream *zs, const void *src, size_t size, struct chck_buffer *out)
+{
+   assert(zs && (src || !size) && out);
+
+   if (unlikely(!src && size))
+      return false;
+
+   // avail_in is only uInt
+   do {
+      const uInt chunk = (size > UINT_MAX ? UINT_MAX : size);
+      zs->stream.next_in = (Bytef*)src;
+      zs->stream.avail_in = chunk;
+
+      if (!run(zs, Z_NO_FLUSH, out))
+         return false;
+
+      src = (const uint8_t*)src + chunk;
+      size -= chunk;
+   } while (size > 0);
+
+   return true;
+}
+
+bool
+chck_zstream_write_from_fd(struct chck_zstream *zs, int fd, size_t size, struct chck_buffer *out)
+{
+   assert(zs && out);
+
+   uint8_t chunk[CHUNK];
+   for (size_t total = 0; !size || total < size;) {
+      const size_t want = (size && size - total < sizeof(chunk) ? size - total : sizeof(chunk));
+
+      ssize_t ret;
+      if ((ret = read(fd, chunk, want)) < 0) {
+         if (errno == EINTR)
+            continue;
+
+         return false;
+      }
+
+      if (!ret)
+         break;
+
+      if (!chck_zstream_write(zs, chunk, ret, out))
+         return false;
+
+      total += ret;
+   }
+
+   return true;
+}
+
+bool
+chck_zstream_write_from_file(struct chck_zstream *zs, FILE *src, size_t size, struct chck_buffer *out)
+{
+   assert(zs && src && out);
+
+   uint8_t chunk[CHUNK];
+   for (size_t total = 0; !size || total < size;) {
+      const size_t want = (size && size - total < sizeof(chunk) ? size - total : sizeof(chunk));
+      const size_t ret = fread(chunk, 1, want, src);
+
+      if (ret > 0 && !chck_zstream_write(zs, chunk, ret, out))
+         return false;
+
+      if (ret < want)
+         return !ferror(src);
+
+      total += ret;
+   }
+
+   return true;
+}
+
+bool
+chck_zstream_finish(struct chck_zstream *zs, struct chck_buffer *out)
+{
+   assert(zs && out);
+
+   zs->stream.next_in = NULL;
+   zs->stream.avail_in = 0;
+   return run(zs, Z_FINISH, out);
+}
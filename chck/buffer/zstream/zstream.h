@@ -0,0 +1,46 @@
+#ifndef __chck_zstream__
+#define __chck_zstream__
+
+#include <chck/macros.h>
+#include <chck/buffer/buffer.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <zlib.h>
+
+struct chck_zstream {
+   z_stream stream;
+
+   // output space to reserve on first write, 0 == grow as needed
+   size_t hint;
+
+   // deflate == true, compresses, otherwise decompresses
+   bool deflate;
+
+   // end of the compressed stream was reached
+   bool done;
+};
+
+/**
+ * Streaming zlib compression and decompression into chck_buffer.
+ * Input is consumed in chunks as it is written, output is appended to curpos of the out buffer, which grows geometrically.
+ *
+ * size is the total uncompressed size when it's known, 0 otherwise.
+ * With known size the output space is reserved once up front, and decompression runs straight into it without growing the buffer.
+ *
+ * chck_zstream_finish flushes the rest of the output, and fails if inflate didn't reach the end of the compressed stream.
+ * Data past the end of the compressed stream is an error.
+ *
+ * chck_zstream_write_from_fd and chck_zstream_write_from_file read size bytes, or until end of file when size is 0.
+ */
+
+CHCK_NONULL bool chck_zstream_deflate(struct chck_zstream *zs, int level, size_t size);
+CHCK_NONULL bool chck_zstream_inflate(struct chck_zstream *zs, size_t size);
+void chck_zstream_release(struct chck_zstream *zs);
+
+CHCK_NONULLV(1, 4) bool chck_zstream_write(struct chck_zstream *zs, const void *src, size_t size, struct chck_buffer *out);
+CHCK_NONULL bool chck_zstream_write_from_fd(struct chck_zstream *zs, int fd, size_t size, struct chck_buffer *out);
+CHCK_NONULL bool chck_zstream_write_from_file(struct chck_zstream *zs, FILE *src, size_t size, struct chck_buffer *out);
+CHCK_NONULL bool chck_zstream_finish(struct chck_zstream *zs, struct chck_buffer *out);
+
+#endif /* __chck_zstream__ */
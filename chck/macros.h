@@ -23,4 +23,9 @@
 #  define CHCK_MALLOC
 #endif
 
+// assumed cache line size, used for padding and aligning data that different threads write
+#ifndef CHCK_CACHE_LINE
+#  define CHCK_CACHE_LINE 64
+#endif
+
 #endif /* __chck_macros_h__ */
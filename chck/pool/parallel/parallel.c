@@ -0,0 +1,218 @@
+#include "parallel.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <assert.h>
+
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#  include <poll.h>
+#endif
+
+// don't split pools smaller than this
+#define MIN_CHUNK 1024
+
+struct chunk {
+   void (*function)(void *item, void *partial);
+   void (*reduce)(void *result, const void *partial);
+   void *result, *partial;
+
+   // items, and map of used items for chck_pool
+   void *items;
+   const bool *map;
+
+   size_t member, begin, end;
+};
+
+static void
+work(struct chunk *chunk)
+{
+   assert(chunk);
+
+   for (size_t i = chunk->begin; i < chunk->end; ++i) {
+      if (chunk->map && !chunk->map[i])
+         continue;
+
+      chunk->function(chunk->items + i * chunk->member, chunk->partial);
+   }
+}
+
+static void
+callback(struct chunk *chunk)
+{
+   assert(chunk);
+
+   if (chunk->reduce && chunk->partial)
+      chunk->reduce(chunk->result, chunk->partial);
+}
+
+static inline size_t
+gcd(size_t a, size_t b)
+{
+   while (b) {
+      const size_t t = a % b;
+      a = b;
+      b = t;
+   }
+   return a;
+}
+
+static void*
+get_partials(struct chck_pool_parallel *parallel, size_t stride, size_t nchunks)
+{
+   assert(parallel);
+
+   size_t sz;
+   if (unlikely(chck_mul_ofsz(stride, nchunks, &sz)) || unlikely(chck_add_ofsz(sz, CHCK_CACHE_LINE, &sz)))
+      return NULL;
+
+   if (sz > parallel->partials_size) {
+      void *tmp;
+      if (!(tmp = realloc(parallel->partials, sz)))
+         return NULL;
+
+      parallel->partials = tmp;
+      parallel->partials_size = sz;
+   }
+
+   void *aligned = (void*)(((uintptr_t)parallel->partials + CHCK_CACHE_LINE - 1) & ~(uintptr_t)(CHCK_CACHE_LINE - 1));
+   memset(aligned, 0, stride * nchunks);
+   return aligned;
+}
+
+static bool
+for_each(struct chck_pool_parallel *parallel, void *items, const bool *map, size_t member, size_t count, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && function && member > 0);
+
+   if (!count)
+      return true;
+
+   // items at this interval start at the same offset within cache line
+   const size_t line = CHCK_CACHE_LINE / gcd(member, CHCK_CACHE_LINE);
+
+   // first item that starts a cache line, if the item size and buffer address allow any
+   size_t first;
+   for (first = 0; first < line && ((uintptr_t)items + first * member) % CHCK_CACHE_LINE; ++first);
+   first = (first < line ? first : 0);
+
+   // one chunk for every queue slot, and one for this thread
+   const size_t slots = parallel->tqueue.tasks.qsize + 1;
+   size_t per = (count + slots - 1) / slots;
+   per = (per < MIN_CHUNK ? MIN_CHUNK : per);
+   per = ((per + line - 1) / line) * line;
+
+   // chunk length is multiple of line and boundaries are counted from the first aligned item, so workers don't share cache lines
+   // the first chunk also takes the items before it
+   const size_t nchunks = (count > first + per ? (count - first + per - 1) / per : 1);
+
+   const size_t stride = ((rsize + CHCK_CACHE_LINE - 1) / CHCK_CACHE_LINE) * CHCK_CACHE_LINE;
+   void *partials = NULL;
+   if (rsize > 0 && !(partials = get_partials(parallel, stride, nchunks)))
+      return false;
+
+   for (size_t c = nchunks; c > 0; --c) {
+      struct chunk chunk = {
+         .function = function,
+         .reduce = reduce,
+         .result = result,
+         .partial = (partials ? partials + (c - 1) * stride : NULL),
+         .items = items,
+         .map = map,
+         .member = member,
+         .begin = (c > 1 ? first + (c - 1) * per : 0),
+         .end = (c < nchunks ? first + c * per : count),
+      };
+
+      // first chunk is processed on this thread, also fall back to it if the queue refuses the task
+      if (c > 1 && chck_tqueue_add_task(&parallel->tqueue, &chunk, 0))
+         continue;
+
+      work(&chunk);
+      callback(&chunk);
+   }
+
+   // sleep until chunks finish, the slowest one may take a while
+   while (chck_tqueue_collect(&parallel->tqueue)) {
+#ifdef __linux__
+      const int fd = chck_tqueue_get_fd(&parallel->tqueue);
+      if (fd >= 0) {
+         struct pollfd pfd = { .fd = fd, .events = POLLIN };
+         poll(&pfd, 1, -1);
+         continue;
+      }
+#endif
+
+      sched_yield();
+   }
+
+   return true;
+}
+
+bool
+chck_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && pool && function);
+   return for_each(parallel, pool->items.buffer, pool->map.buffer, pool->items.member, pool->items.used / pool->items.member, function, reduce, result, rsize);
+}
+
+bool
+chck_iter_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_iter_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && pool && function);
+   return for_each(parallel, pool->items.buffer, NULL, pool->items.member, pool->items.count, function, reduce, result, rsize);
+}
+
+bool
+chck_ring_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_ring_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && pool && function);
+   return for_each(parallel, pool->items.buffer, NULL, pool->items.member, pool->items.count, function, reduce, result, rsize);
+}
+
+void
+chck_pool_parallel_release(struct chck_pool_parallel *parallel)
+{
+   if (!parallel)
+      return;
+
+   chck_tqueue_release(&parallel->tqueue);
+   free(parallel->partials);
+   memset(parallel, 0, sizeof(struct chck_pool_parallel));
+}
+
+bool
+chck_pool_parallel(struct chck_pool_parallel *parallel, size_t nthreads)
+{
+   assert(parallel && nthreads > 0);
+   memset(parallel, 0, sizeof(struct chck_pool_parallel));
+
+   if (unlikely(!nthreads))
+      return false;
+
+   // few chunks per thread, so uneven chunks balance out
+   size_t qsize;
+   if (unlikely(chck_mul_ofsz(nthreads, 4, &qsize)))
+      return false;
+
+   if (!chck_tqueue(&parallel->tqueue, nthreads, qsize, sizeof(struct chunk), work, callback, NULL))
+      return false;
+
+   // don't create and join the threads for every for_each
+   chck_tqueue_set_keep_alive(&parallel->tqueue, true, 0);
+
+#ifdef __linux__
+   // for waiting the chunks, tqueue keeps its own copy
+   int fd;
+   if ((fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) >= 0) {
+      chck_tqueue_set_fd(&parallel->tqueue, fd);
+      close(fd);
+   }
+#endif
+
+   parallel->nthreads = nthreads;
+   return true;
+}
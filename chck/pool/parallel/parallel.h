@@ -0,0 +1,40 @@
+#ifndef __chck_pool_parallel__
+#define __chck_pool_parallel__
+
+#include <chck/macros.h>
+#include <chck/pool/pool.h>
+#include <chck/thread/queue/queue.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct chck_pool_parallel {
+   struct chck_tqueue tqueue;
+
+   // storage for per-chunk partial results (each on its own cache line)
+   void *partials;
+   size_t partials_size;
+
+   // number of worker threads
+   size_t nthreads;
+};
+
+/**
+ * Parallel for_each over pool contents.
+ * Pool is split into cache line aligned chunks, which are ran on the worker threads of chck_tqueue (and the calling thread).
+ * The call returns when every item has been visited.
+ *
+ * function(item, partial) is called for every item, partial is per-chunk zero initialized storage of rsize bytes.
+ * reduce(result, partial) is called on the calling thread for each chunk once the chunk is done, so the result does not need locking.
+ * If rsize is 0, partial is NULL and reduce is not called.
+ *
+ * The function must not modify the pool layout (add/remove items), only the items themself.
+ * Like chck_tqueue, chck_pool_parallel may only be used from the thread that created it.
+ */
+
+CHCK_NONULL bool chck_pool_parallel(struct chck_pool_parallel *parallel, size_t nthreads);
+void chck_pool_parallel_release(struct chck_pool_parallel *parallel);
+CHCK_NONULLV(1, 2, 3) bool chck_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize);
+CHCK_NONULLV(1, 2, 3) bool chck_iter_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_iter_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize);
+CHCK_NONULLV(1, 2, 3) bool chck_ring_pool_parallel_for_each(struct chck_pool_parallel *parallel, const struct chck_ring_pool *pool, void (*function)(void *item, void *partial), void (*reduce)(void *result, const void *partial), void *result, size_t rsize);
+
+#endif /* __chck_pool_parallel__ */
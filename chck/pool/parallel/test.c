@@ -0,0 +1,111 @@
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+struct item {
+   uint32_t a;
+   uint32_t b;
+};
+
+static void
+square(struct item *item, uint64_t *partial)
+{
+   item->b = item->a * item->a;
+
+   if (partial)
+      *partial += item->a;
+}
+
+static void
+sum(uint64_t *result, const uint64_t *partial)
+{
+   *result += *partial;
+}
+
+int main(void)
+{
+   struct chck_pool_parallel parallel;
+   assert(chck_pool_parallel(&parallel, 4));
+
+   /* TEST: iter pool */
+   {
+      const uint32_t iters = 0xFFFFF;
+      struct chck_iter_pool pool;
+      assert(chck_iter_pool(&pool, 32, iters, sizeof(struct item)));
+
+      for (uint32_t i = 0; i < iters; ++i)
+         assert(chck_iter_pool_push_back(&pool, (&(struct item){i % 0xFFFF, 0})));
+
+      for (int r = 0; r < 4; ++r) {
+         uint64_t result = 0;
+         assert(chck_iter_pool_parallel_for_each(&parallel, &pool, (void*)square, (void*)sum, &result, sizeof(uint64_t)));
+
+         uint64_t expect = 0;
+         struct item *current;
+         chck_iter_pool_for_each(&pool, current) {
+            assert(current->b == current->a * current->a);
+            expect += current->a;
+            current->b = 0;
+         }
+         assert(result == expect);
+      }
+
+      // no reduction
+      assert(chck_iter_pool_parallel_for_each(&parallel, &pool, (void*)square, NULL, NULL, 0));
+
+      struct item *current;
+      chck_iter_pool_for_each(&pool, current)
+         assert(current->b == current->a * current->a);
+
+      chck_iter_pool_release(&pool);
+   }
+
+   /* TEST: pool with holes */
+   {
+      struct chck_pool pool;
+      assert(chck_pool(&pool, 32, 0, sizeof(struct item)));
+
+      for (uint32_t i = 0; i < 10000; ++i)
+         assert(chck_pool_add(&pool, (&(struct item){i, 0}), NULL));
+
+      for (uint32_t i = 0; i < 10000; i += 3)
+         chck_pool_remove(&pool, i);
+
+      uint64_t result = 0, expect = 0;
+      assert(chck_pool_parallel_for_each(&parallel, &pool, (void*)square, (void*)sum, &result, sizeof(uint64_t)));
+
+      struct item *current;
+      chck_pool_for_each(&pool, current) {
+         assert(current->b == current->a * current->a);
+         expect += current->a;
+      }
+      assert(result == expect);
+
+      chck_pool_release(&pool);
+   }
+
+   /* TEST: ring pool and empty pool */
+   {
+      struct chck_ring_pool pool;
+      assert(chck_ring_pool(&pool, 32, 0, sizeof(struct item)));
+
+      uint64_t result = 0;
+      assert(chck_ring_pool_parallel_for_each(&parallel, &pool, (void*)square, (void*)sum, &result, sizeof(uint64_t)));
+      assert(result == 0);
+
+      for (uint32_t i = 0; i < 100; ++i)
+         assert(chck_ring_pool_push_front(&pool, (&(struct item){i, 0})));
+
+      assert(chck_ring_pool_parallel_for_each(&parallel, &pool, (void*)square, (void*)sum, &result, sizeof(uint64_t)));
+      assert(result == 99 * 100 / 2);
+
+      chck_ring_pool_release(&pool);
+   }
+
+   chck_pool_parallel_release(&parallel);
+   return EXIT_SUCCESS;
+}
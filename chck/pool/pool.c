@@ -179,6 +179,66 @@ pool_buffer_remove_move(struct chck_pool_buffer *pb, size_t index)
       pool_buffer_resize(pb, pb->allocated - pb->member * pb->step);
 }
 
+static void
+pool_buffer_shrink(struct chck_pool_buffer *pb)
+{
+   assert(pb);
+
+   const size_t step = pb->member * pb->step;
+   if (pb->used + step < pb->allocated)
+      pool_buffer_resize(pb, pb->allocated - ((pb->allocated - pb->used - 1) / step) * step);
+}
+
+static void
+pool_buffer_remove_swap(struct chck_pool_buffer *pb, size_t index)
+{
+   assert(pb);
+
+   size_t slot;
+   if (unlikely(chck_mul_ofsz(index, pb->member, &slot)) || unlikely(slot >= pb->used))
+      return;
+
+   if (slot + pb->member < pb->used)
+      memcpy(pb->buffer + slot, pb->buffer + pb->used - pb->member, pb->member);
+
+   pb->used -= pb->member;
+   pb->count--;
+
+   if (pb->used + pb->member * pb->step < pb->allocated)
+      pool_buffer_resize(pb, pb->allocated - pb->member * pb->step);
+}
+
+static void
+pool_buffer_retain_if(struct chck_pool_buffer *pb, bool (*function)(void *item, void *userdata), void *userdata)
+{
+   assert(pb && function);
+
+   // single pass, kept items are moved down in runs
+   size_t dst = 0, run = 0, run_start = 0;
+   for (size_t pos = 0; pos < pb->used; pos += pb->member) {
+      if (function(pb->buffer + pos, userdata)) {
+         if (!run)
+            run_start = pos;
+
+         run += pb->member;
+         continue;
+      }
+
+      if (run && dst != run_start)
+         memmove(pb->buffer + dst, pb->buffer + run_start, run);
+
+      dst += run;
+      run = 0;
+   }
+
+   if (run && dst != run_start)
+      memmove(pb->buffer + dst, pb->buffer + run_start, run);
+
+   pb->used = dst + run;
+   pb->count = pb->used / pb->member;
+   pool_buffer_shrink(pb);
+}
+
 static void*
 pool_buffer_iter(const struct chck_pool_buffer *pb, size_t *iter, bool reverse)
 {
@@ -203,7 +263,7 @@ pool_buffer_set_c_array(struct chck_pool_buffer *pb, const void *items, size_t m
       memcpy(copy, items, memb * pb->member);
    }
 
-   pool_buffer_release(pb);
+   pool_buffer_flush(pb, true);
 
    pb->buffer = copy;
    pb->used = pb->allocated = memb * pb->member;
@@ -424,6 +484,18 @@ chck_iter_pool_empty(struct chck_iter_pool *pool)
    pool_buffer_flush(&pool->items, false);
 }
 
+bool
+chck_iter_pool_reserve(struct chck_iter_pool *pool, size_t capacity)
+{
+   assert(pool);
+
+   size_t sz;
+   if (unlikely(chck_mul_ofsz(capacity, pool->items.member, &sz)))
+      return false;
+
+   return (sz <= pool->items.allocated || pool_buffer_resize(&pool->items, sz));
+}
+
 void*
 chck_iter_pool_get(const struct chck_iter_pool *pool, size_t index)
 {
@@ -469,6 +541,20 @@ chck_iter_pool_remove(struct chck_iter_pool *pool, size_t index)
    pool_buffer_remove_move(&pool->items, index);
 }
 
+void
+chck_iter_pool_remove_unordered(struct chck_iter_pool *pool, size_t index)
+{
+   assert(pool);
+   pool_buffer_remove_swap(&pool->items, index);
+}
+
+void
+chck_iter_pool_retain_if(struct chck_iter_pool *pool, bool (*function)(void *item, void *userdata), void *userdata)
+{
+   assert(pool && function);
+   pool_buffer_retain_if(&pool->items, function, userdata);
+}
+
 void*
 chck_iter_pool_iter(const struct chck_iter_pool *pool, size_t *iter, bool reverse)
 {
@@ -595,3 +681,386 @@ chck_ring_pool_to_c_array(struct chck_ring_pool *pool, size_t *out_memb)
    assert(pool);
    return pool_buffer_to_c_array(&pool->items, out_memb);
 }
+
+// chunk header, keeps the items after it aligned
+#define CHUNK_HEADER (2 * sizeof(void*))
+
+static inline size_t*
+chunk_count(void *chunk)
+{
+   return chunk;
+}
+
+static inline void*
+chunk_item(const struct chck_chunk_pool *pool, void *chunk, size_t index)
+{
+   return chunk + CHUNK_HEADER + index * pool->member;
+}
+
+static inline void*
+chunk_at(const struct chck_chunk_pool *pool, size_t index)
+{
+   assert(index < pool->chunks.count);
+   return *(void**)(pool->chunks.buffer + index * pool->chunks.member);
+}
+
+static void
+chunk_tree_add(struct chck_chunk_pool *pool, size_t index, bool remove)
+{
+   assert(pool);
+
+   size_t *tree = pool->tree.buffer;
+   for (size_t i = index + 1; i <= pool->chunks.count; i += (i & -i))
+      tree[i] = (remove ? tree[i] - 1 : tree[i] + 1);
+}
+
+static void
+chunk_tree_rebuild(struct chck_chunk_pool *pool)
+{
+   assert(pool);
+
+   size_t *tree;
+   if (!(tree = pool->tree.buffer))
+      return;
+
+   // chunk_new reserves the space for tree, so this never allocates
+   const size_t n = pool->chunks.count;
+   assert(pool->tree.allocated >= (n + 1) * pool->tree.member);
+
+   tree[0] = 0;
+   for (size_t i = 1; i <= n; ++i)
+      tree[i] = *chunk_count(chunk_at(pool, i - 1));
+
+   for (size_t i = 1; i <= n; ++i) {
+      const size_t parent = i + (i & -i);
+      if (parent <= n)
+         tree[parent] += tree[i];
+   }
+
+   pool->tree.count = n + 1;
+   pool->tree.used = (n + 1) * pool->tree.member;
+}
+
+static size_t
+chunk_find(const struct chck_chunk_pool *pool, size_t index, size_t *out_offset)
+{
+   assert(pool && out_offset && index < pool->count);
+
+   const size_t n = pool->chunks.count;
+   const size_t *tree = pool->tree.buffer;
+
+   size_t step = 1;
+   while (step <= n / 2)
+      step <<= 1;
+
+   size_t pos = 0;
+   for (; step > 0; step >>= 1) {
+      if (pos + step <= n && tree[pos + step] <= index) {
+         pos += step;
+         index -= tree[pos];
+      }
+   }
+
+   assert(pos < n);
+   *out_offset = index;
+   return pos;
+}
+
+static void*
+chunk_new(struct chck_chunk_pool *pool, size_t index)
+{
+   assert(pool);
+
+   size_t sz;
+   if (unlikely(chck_mul_ofsz(pool->chunks.count + 2, pool->tree.member, &sz)))
+      return NULL;
+
+   if (sz > pool->tree.allocated && !pool_buffer_resize(&pool->tree, sz + pool->tree.member * pool->tree.step))
+      return NULL;
+
+   void *chunk;
+   if (unlikely(chck_mul_ofsz(pool->chunk, pool->member, &sz)) || !(chunk = chck_malloc_add_of(sz, CHUNK_HEADER)))
+      return NULL;
+
+   *chunk_count(chunk) = 0;
+
+   if (!pool_buffer_add_move(&pool->chunks, &chunk, index * pool->chunks.member, NULL)) {
+      free(chunk);
+      return NULL;
+   }
+
+   return chunk;
+}
+
+static void
+chunk_remove(struct chck_chunk_pool *pool, size_t index)
+{
+   assert(pool);
+   free(chunk_at(pool, index));
+   pool_buffer_remove_move(&pool->chunks, index);
+}
+
+static void*
+chunk_pool_insert(struct chck_chunk_pool *pool, size_t index, const void *data)
+{
+   assert(pool);
+
+   if (index > pool->count)
+      index = pool->count;
+
+   void *chunk;
+   size_t c, off;
+   if (!pool->chunks.count) {
+      if (!(chunk = chunk_new(pool, 0)))
+         return NULL;
+
+      c = off = 0;
+   } else if (index == pool->count) {
+      c = pool->chunks.count - 1;
+      chunk = chunk_at(pool, c);
+      off = *chunk_count(chunk);
+   } else {
+      c = chunk_find(pool, index, &off);
+      chunk = chunk_at(pool, c);
+   }
+
+   if (*chunk_count(chunk) >= pool->chunk) {
+      if (off == 0 || off >= pool->chunk) {
+         // inserting to either end of full chunk, start a new chunk there
+         c += (off > 0);
+
+         if (!(chunk = chunk_new(pool, c)))
+            return NULL;
+
+         off = 0;
+      } else {
+         // split the chunk in half
+         void *next;
+         if (!(next = chunk_new(pool, c + 1)))
+            return NULL;
+
+         const size_t keep = *chunk_count(chunk) / 2;
+         *chunk_count(next) = *chunk_count(chunk) - keep;
+         memcpy(chunk_item(pool, next, 0), chunk_item(pool, chunk, keep), *chunk_count(next) * pool->member);
+         *chunk_count(chunk) = keep;
+
+         if (off > keep) {
+            chunk = next;
+            off -= keep;
+            ++c;
+         }
+      }
+
+      chunk_tree_rebuild(pool);
+   }
+
+   size_t *count = chunk_count(chunk);
+   if (off < *count)
+      memmove(chunk_item(pool, chunk, off + 1), chunk_item(pool, chunk, off), (*count - off) * pool->member);
+
+   void *ptr = chunk_item(pool, chunk, off);
+   if (data) {
+      memcpy(ptr, data, pool->member);
+   } else {
+      memset(ptr, 0, pool->member);
+   }
+
+   ++*count;
+   ++pool->count;
+   chunk_tree_add(pool, c, false);
+   return ptr;
+}
+
+bool
+chck_chunk_pool(struct chck_chunk_pool *pool, size_t grow, size_t chunk, size_t member_size)
+{
+   assert(pool && member_size > 0);
+
+   if (unlikely(!member_size))
+      return false;
+
+   memset(pool, 0, sizeof(struct chck_chunk_pool));
+   pool->member = member_size;
+
+   // by default aim for ~4KiB chunks, but keep at least few items in them
+   pool->chunk = (chunk ? chunk : (member_size < 4096 / 16 ? 4096 / member_size : 16));
+
+   return (pool_buffer(&pool->chunks, grow, 0, sizeof(void*)) &&
+           pool_buffer(&pool->tree, grow, 0, sizeof(size_t)));
+}
+
+bool
+chck_chunk_pool_from_c_array(struct chck_chunk_pool *pool, const void *items, size_t memb, size_t grow, size_t chunk, size_t member_size)
+{
+   return (chck_chunk_pool(pool, grow, chunk, member_size) && chck_chunk_pool_set_c_array(pool, items, memb));
+}
+
+void
+chck_chunk_pool_release(struct chck_chunk_pool *pool)
+{
+   if (!pool)
+      return;
+
+   chck_chunk_pool_flush(pool);
+   pool_buffer_release(&pool->chunks);
+   pool_buffer_release(&pool->tree);
+}
+
+void
+chck_chunk_pool_flush(struct chck_chunk_pool *pool)
+{
+   assert(pool);
+
+   for (size_t i = 0; i < pool->chunks.count; ++i)
+      free(chunk_at(pool, i));
+
+   pool_buffer_flush(&pool->chunks, true);
+   pool_buffer_flush(&pool->tree, true);
+   pool->count = 0;
+}
+
+void*
+chck_chunk_pool_get(const struct chck_chunk_pool *pool, size_t index)
+{
+   assert(pool);
+
+   if (unlikely(index >= pool->count))
+      return NULL;
+
+   size_t off;
+   const size_t c = chunk_find(pool, index, &off);
+   return chunk_item(pool, chunk_at(pool, c), off);
+}
+
+void*
+chck_chunk_pool_get_last(const struct chck_chunk_pool *pool)
+{
+   assert(pool);
+
+   if (unlikely(!pool->count))
+      return NULL;
+
+   void *chunk = chunk_at(pool, pool->chunks.count - 1);
+   return chunk_item(pool, chunk, *chunk_count(chunk) - 1);
+}
+
+void*
+chck_chunk_pool_push_front(struct chck_chunk_pool *pool, const void *data)
+{
+   assert(pool);
+   return chunk_pool_insert(pool, 0, data);
+}
+
+void*
+chck_chunk_pool_push_back(struct chck_chunk_pool *pool, const void *data)
+{
+   assert(pool);
+   return chunk_pool_insert(pool, pool->count, data);
+}
+
+void*
+chck_chunk_pool_insert(struct chck_chunk_pool *pool, size_t index, const void *data)
+{
+   assert(pool);
+   return chunk_pool_insert(pool, index, data);
+}
+
+void
+chck_chunk_pool_remove(struct chck_chunk_pool *pool, size_t index)
+{
+   assert(pool);
+
+   if (unlikely(index >= pool->count))
+      return;
+
+   size_t off;
+   const size_t c = chunk_find(pool, index, &off);
+   void *chunk = chunk_at(pool, c);
+   size_t *count = chunk_count(chunk);
+
+   if (off + 1 < *count)
+      memmove(chunk_item(pool, chunk, off), chunk_item(pool, chunk, off + 1), (*count - off - 1) * pool->member);
+
+   --*count;
+   --pool->count;
+
+   if (!*count) {
+      chunk_remove(pool, c);
+      chunk_tree_rebuild(pool);
+      return;
+   }
+
+   // merge sparse neighbours, so the pool does not degrade into lots of tiny chunks
+   if (c + 1 < pool->chunks.count) {
+      void *next = chunk_at(pool, c + 1);
+      if (*count + *chunk_count(next) <= pool->chunk / 2) {
+         memcpy(chunk_item(pool, chunk, *count), chunk_item(pool, next, 0), *chunk_count(next) * pool->member);
+         *count += *chunk_count(next);
+         chunk_remove(pool, c + 1);
+         chunk_tree_rebuild(pool);
+         return;
+      }
+   }
+
+   chunk_tree_add(pool, c, true);
+}
+
+void*
+chck_chunk_pool_iter(const struct chck_chunk_pool *pool, size_t *iter, bool reverse)
+{
+   assert(pool && iter);
+
+   // iter is chunk * pool->chunk + offset, so stepping never has to search the tree
+   const size_t c = *iter / pool->chunk;
+   if (c >= pool->chunks.count)
+      return NULL;
+
+   void *chunk = chunk_at(pool, c);
+   const size_t count = *chunk_count(chunk);
+   size_t off = *iter % pool->chunk;
+
+   // reverse iteration starts from the last slot of the last chunk
+   if (off >= count) {
+      if (!reverse) {
+         *iter = (c + 1) * pool->chunk;
+         return chck_chunk_pool_iter(pool, iter, reverse);
+      }
+
+      off = count - 1;
+   }
+
+   if (reverse) {
+      if (off > 0)
+         *iter = c * pool->chunk + off - 1;
+      else
+         *iter = (c > 0 ? (c - 1) * pool->chunk + *chunk_count(chunk_at(pool, c - 1)) - 1 : (size_t)-1);
+   } else {
+      *iter = (off + 1 < count ? c * pool->chunk + off + 1 : (c + 1) * pool->chunk);
+   }
+
+   return chunk_item(pool, chunk, off);
+}
+
+bool
+chck_chunk_pool_set_c_array(struct chck_chunk_pool *pool, const void *items, size_t memb)
+{
+   assert(pool);
+
+   chck_chunk_pool_flush(pool);
+
+   for (size_t i = 0; items && i < memb; i += pool->chunk) {
+      void *chunk;
+      if (!(chunk = chunk_new(pool, pool->chunks.count))) {
+         chck_chunk_pool_flush(pool);
+         return false;
+      }
+
+      const size_t count = (memb - i < pool->chunk ? memb - i : pool->chunk);
+      memcpy(chunk_item(pool, chunk, 0), items + i * pool->member, count * pool->member);
+      *chunk_count(chunk) = count;
+      pool->count += count;
+   }
+
+   chunk_tree_rebuild(pool);
+   return true;
+}
@@ -36,6 +36,20 @@ struct chck_ring_pool {
    void *popped;
 };
 
+struct chck_chunk_pool {
+   // pointers to chunks, each chunk stores up to 'chunk' items
+   struct chck_pool_buffer chunks;
+
+   // fenwick tree of item counts in chunks (for positional lookups)
+   struct chck_pool_buffer tree;
+
+   // items per chunk and member size
+   size_t chunk, member;
+
+   // number of items in the pool
+   size_t count;
+};
+
 /**
  * Pools are manual memory buffers for your data (usually structs).
  * Pools may contain holes as whenever you remove item, the space is not removed, but instead marked as unused.
@@ -74,6 +88,9 @@ CHCK_NONULLV(1) void* chck_pool_to_c_array(struct chck_pool *pool, size_t *memb)
  * Whenever you remove a item from IterPool, the items after that get memmoved.
  * Thus the indices returned by IterPool functions are _not_ safe.
  *
+ * If you don't care about the order, chck_iter_pool_remove_unordered moves the last item to the removed slot instead, O(1).
+ * chck_iter_pool_retain_if removes every item the function returns false for in single pass, keeping the order.
+ *
  * As the name implies, use this pool only if you need to access items by iteration.
  */
 
@@ -94,12 +111,15 @@ CHCK_NONULL bool chck_iter_pool_from_c_array(struct chck_iter_pool *pool, const
 void chck_iter_pool_release(struct chck_iter_pool *pool);
 CHCK_NONULL void chck_iter_pool_flush(struct chck_iter_pool *pool);
 CHCK_NONULL void chck_iter_pool_empty(struct chck_iter_pool *pool);
+CHCK_NONULL bool chck_iter_pool_reserve(struct chck_iter_pool *pool, size_t capacity);
 CHCK_NONULL void* chck_iter_pool_get(const struct chck_iter_pool *pool, size_t index);
 CHCK_NONULL void* chck_iter_pool_get_last(const struct chck_iter_pool *pool);
 CHCK_NONULLV(1) void* chck_iter_pool_push_front(struct chck_iter_pool *pool, const void *data);
 CHCK_NONULLV(1) void* chck_iter_pool_push_back(struct chck_iter_pool *pool, const void *data);
 CHCK_NONULLV(1) void* chck_iter_pool_insert(struct chck_iter_pool *pool, size_t index, const void *data);
 CHCK_NONULL void chck_iter_pool_remove(struct chck_iter_pool *pool, size_t index);
+CHCK_NONULL void chck_iter_pool_remove_unordered(struct chck_iter_pool *pool, size_t index);
+CHCK_NONULLV(1, 2) void chck_iter_pool_retain_if(struct chck_iter_pool *pool, bool (*function)(void *item, void *userdata), void *userdata);
 CHCK_NONULL void* chck_iter_pool_iter(const struct chck_iter_pool *pool, size_t *iter, bool reverse);
 CHCK_NONULLV(1) bool chck_iter_pool_set_c_array(struct chck_iter_pool *pool, const void *items, size_t memb); /* struct item *c_array; */
 CHCK_NONULLV(1) void* chck_iter_pool_to_c_array(struct chck_iter_pool *pool, size_t *memb); /* struct item *c_array; */
@@ -134,4 +154,43 @@ CHCK_NONULL void* chck_ring_pool_iter(const struct chck_ring_pool *pool, size_t
 CHCK_NONULLV(1) bool chck_ring_pool_set_c_array(struct chck_ring_pool *pool, const void *items, size_t memb); /* struct item *c_array; */
 CHCK_NONULLV(1) void* chck_ring_pool_to_c_array(struct chck_ring_pool *pool, size_t *memb); /* struct item *c_array; */
 
+/**
+ * ChunkPools are ordered like IterPools, but items are stored in fixed size chunks.
+ * Inserting or removing item only memmoves the items inside the chunk, and chunks are located with fenwick tree.
+ * Thus positional insert/remove/get are O(log n + chunk) instead of O(n).
+ *
+ * Items never move between chunks except when chunk is split or merged, but you should still
+ * treat the returned pointers and indices like IterPool ones.
+ *
+ * Unlike the other pools, iter of chck_chunk_pool_iter is position within the chunks, not index, so iteration walks the chunks linearly.
+ * Start from 0, or from (pool->chunks.count * pool->chunk - 1) in reverse, like the for_each macros do.
+ *
+ * Use this pool instead of IterPool if you insert or remove a lot from the middle of large pools.
+ */
+
+#define chck_chunk_pool_for_each_call(pool, function, ...) \
+{ void *_P; for (size_t _I = 0; (_P = chck_chunk_pool_iter(pool, &_I, false));) function(_P, ##__VA_ARGS__); }
+
+#define chck_chunk_pool_for_each_call_reverse(pool, function, ...) \
+{ void *_P; for (size_t _I = (pool)->chunks.count * (pool)->chunk - 1; (_P = chck_chunk_pool_iter(pool, &_I, true));) function(_P, ##__VA_ARGS__); }
+
+#define chck_chunk_pool_for_each(pool, pos) \
+   for (size_t _I = 0; (pos = chck_chunk_pool_iter(pool, &_I, false));)
+
+#define chck_chunk_pool_for_each_reverse(pool, pos) \
+   for (size_t _I = (pool)->chunks.count * (pool)->chunk - 1; (pos = chck_chunk_pool_iter(pool, &_I, true));)
+
+CHCK_NONULL bool chck_chunk_pool(struct chck_chunk_pool *pool, size_t grow, size_t chunk, size_t member_size);
+CHCK_NONULL bool chck_chunk_pool_from_c_array(struct chck_chunk_pool *pool, const void *items, size_t memb, size_t grow, size_t chunk, size_t member_size);
+void chck_chunk_pool_release(struct chck_chunk_pool *pool);
+CHCK_NONULL void chck_chunk_pool_flush(struct chck_chunk_pool *pool);
+CHCK_NONULL void* chck_chunk_pool_get(const struct chck_chunk_pool *pool, size_t index);
+CHCK_NONULL void* chck_chunk_pool_get_last(const struct chck_chunk_pool *pool);
+CHCK_NONULLV(1) void* chck_chunk_pool_push_front(struct chck_chunk_pool *pool, const void *data);
+CHCK_NONULLV(1) void* chck_chunk_pool_push_back(struct chck_chunk_pool *pool, const void *data);
+CHCK_NONULLV(1) void* chck_chunk_pool_insert(struct chck_chunk_pool *pool, size_t index, const void *data);
+CHCK_NONULL void chck_chunk_pool_remove(struct chck_chunk_pool *pool, size_t index);
+CHCK_NONULL void* chck_chunk_pool_iter(const struct chck_chunk_pool *pool, size_t *iter, bool reverse);
+CHCK_NONULLV(1) bool chck_chunk_pool_set_c_array(struct chck_chunk_pool *pool, const void *items, size_t memb); /* struct item *c_array; */
+
 #endif /* __chck_pool__ */
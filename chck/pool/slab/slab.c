@@ -0,0 +1,330 @@
+#include "slab.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// alignment of objects (and slab headers)
+#define SLAB_ALIGN (2 * sizeof(void*))
+
+struct chck_slab_magazine {
+   struct chck_slab_magazine *next;
+   size_t count;
+   void *objects[];
+};
+
+struct chck_slab_cache {
+   struct chck_slab *slab;
+   struct chck_slab_magazine *loaded, *previous;
+   struct chck_slab_cache *next, **prev;
+};
+
+static inline size_t
+align(size_t size)
+{
+   return (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+}
+
+static struct chck_slab_magazine*
+magazine_new(const struct chck_slab *slab)
+{
+   assert(slab);
+
+   struct chck_slab_magazine *mag;
+   if (!(mag = chck_malloc_add_of(sizeof(struct chck_slab_magazine), slab->rounds * sizeof(void*))))
+      return NULL;
+
+   mag->next = NULL;
+   mag->count = 0;
+   return mag;
+}
+
+static inline void
+magazine_push(struct chck_slab_magazine **list, struct chck_slab_magazine *mag)
+{
+   assert(list && mag);
+   mag->next = *list;
+   *list = mag;
+}
+
+static inline struct chck_slab_magazine*
+magazine_pop(struct chck_slab_magazine **list)
+{
+   assert(list);
+
+   struct chck_slab_magazine *mag;
+   if ((mag = *list))
+      *list = mag->next;
+
+   return mag;
+}
+
+static void
+magazine_release_list(struct chck_slab_magazine *mag)
+{
+   for (struct chck_slab_magazine *next; mag; mag = next) {
+      next = mag->next;
+      free(mag);
+   }
+}
+
+static void
+depot_put(struct chck_slab *slab, struct chck_slab_magazine *mag)
+{
+   assert(slab);
+
+   if (!mag)
+      return;
+
+   // partially filled magazines go to the full list, allocations only care there is something in them
+   magazine_push((mag->count > 0 ? &slab->depot.full : &slab->depot.empty), mag);
+}
+
+static bool
+depot_carve(struct chck_slab *slab, struct chck_slab_magazine *mag)
+{
+   assert(slab && mag);
+
+   // called with depot lock held
+   while (mag->count < slab->rounds) {
+      if (!slab->depot.slabs || slab->depot.carved >= slab->step) {
+         void *s;
+         if (!(s = chck_malloc_add_of(align(sizeof(void*)), slab->step * slab->member)))
+            return (mag->count > 0);
+
+         *(void**)s = slab->depot.slabs;
+         slab->depot.slabs = s;
+         slab->depot.carved = 0;
+      }
+
+      mag->objects[mag->count++] = (char*)slab->depot.slabs + align(sizeof(void*)) + slab->depot.carved++ * slab->member;
+   }
+
+   return true;
+}
+
+static void
+cache_release(struct chck_slab_cache *cache)
+{
+   assert(cache);
+
+   // called with depot lock held
+   struct chck_slab *slab = cache->slab;
+   depot_put(slab, cache->loaded);
+   depot_put(slab, cache->previous);
+
+   if ((*cache->prev = cache->next))
+      cache->next->prev = cache->prev;
+
+   free(cache);
+}
+
+static void
+cache_destructor(void *arg)
+{
+   assert(arg);
+
+   struct chck_slab_cache *cache = arg;
+   struct chck_slab *slab = cache->slab;
+   pthread_mutex_lock(&slab->depot.mutex);
+   cache_release(cache);
+   pthread_mutex_unlock(&slab->depot.mutex);
+}
+
+static struct chck_slab_cache*
+get_cache(struct chck_slab *slab)
+{
+   assert(slab);
+
+   struct chck_slab_cache *cache;
+   if (likely((cache = pthread_getspecific(slab->key))))
+      return cache;
+
+   if (!(cache = calloc(1, sizeof(struct chck_slab_cache))))
+      return NULL;
+
+   cache->slab = slab;
+
+   if (!(cache->loaded = magazine_new(slab)) || !(cache->previous = magazine_new(slab)))
+      goto fail;
+
+   if (pthread_setspecific(slab->key, cache) != 0)
+      goto fail;
+
+   pthread_mutex_lock(&slab->depot.mutex);
+   cache->prev = &slab->depot.caches;
+   if ((cache->next = slab->depot.caches))
+      cache->next->prev = &cache->next;
+   slab->depot.caches = cache;
+   pthread_mutex_unlock(&slab->depot.mutex);
+   return cache;
+
+fail:
+   free(cache->loaded);
+   free(cache->previous);
+   free(cache);
+   return NULL;
+}
+
+static inline void
+swap_magazines(struct chck_slab_cache *cache)
+{
+   struct chck_slab_magazine *tmp = cache->loaded;
+   cache->loaded = cache->previous;
+   cache->previous = tmp;
+}
+
+void*
+chck_slab_alloc(struct chck_slab *slab)
+{
+   assert(slab);
+
+   struct chck_slab_cache *cache;
+   if (unlikely(!(cache = get_cache(slab))))
+      return NULL;
+
+   if (likely(cache->loaded->count > 0))
+      return cache->loaded->objects[--cache->loaded->count];
+
+   if (cache->previous->count > 0) {
+      swap_magazines(cache);
+      return cache->loaded->objects[--cache->loaded->count];
+   }
+
+   // both magazines are empty, exchange one of them for a full one from depot
+   // or carve new objects from the slab if there are no full magazines
+   pthread_mutex_lock(&slab->depot.mutex);
+
+   struct chck_slab_magazine *full;
+   if ((full = magazine_pop(&slab->depot.full))) {
+      magazine_push(&slab->depot.empty, cache->previous);
+      cache->previous = cache->loaded;
+      cache->loaded = full;
+   } else if (!depot_carve(slab, cache->loaded)) {
+      pthread_mutex_unlock(&slab->depot.mutex);
+      return NULL;
+   }
+
+   pthread_mutex_unlock(&slab->depot.mutex);
+
+   assert(cache->loaded->count > 0);
+   return cache->loaded->objects[--cache->loaded->count];
+}
+
+void
+chck_slab_free(struct chck_slab *slab, void *ptr)
+{
+   assert(slab);
+
+   if (!ptr)
+      return;
+
+   struct chck_slab_cache *cache;
+   if (unlikely(!(cache = get_cache(slab)))) {
+      // no cache for this thread, put the object directly to depot
+      pthread_mutex_lock(&slab->depot.mutex);
+      struct chck_slab_magazine *mag = slab->depot.full;
+      if (!mag || mag->count >= slab->rounds) {
+         if ((mag = magazine_pop(&slab->depot.empty)) || (mag = magazine_new(slab)))
+            magazine_push(&slab->depot.full, mag);
+      }
+
+      // if we can't even allocate magazine, the object is leaked until release
+      if (mag)
+         mag->objects[mag->count++] = ptr;
+
+      pthread_mutex_unlock(&slab->depot.mutex);
+      return;
+   }
+
+   if (likely(cache->loaded->count < slab->rounds)) {
+      cache->loaded->objects[cache->loaded->count++] = ptr;
+      return;
+   }
+
+   if (cache->previous->count < slab->rounds) {
+      swap_magazines(cache);
+      cache->loaded->objects[cache->loaded->count++] = ptr;
+      return;
+   }
+
+   // both magazines are full, give one of them to depot in exchange for empty one
+   pthread_mutex_lock(&slab->depot.mutex);
+   struct chck_slab_magazine *empty;
+   if ((empty = magazine_pop(&slab->depot.empty)))
+      magazine_push(&slab->depot.full, cache->previous);
+   pthread_mutex_unlock(&slab->depot.mutex);
+
+   if (!empty) {
+      // can't get empty magazine, we leak the object until release
+      if (!(empty = magazine_new(slab)))
+         return;
+
+      pthread_mutex_lock(&slab->depot.mutex);
+      magazine_push(&slab->depot.full, cache->previous);
+      pthread_mutex_unlock(&slab->depot.mutex);
+   }
+
+   cache->previous = cache->loaded;
+   cache->loaded = empty;
+   cache->loaded->objects[cache->loaded->count++] = ptr;
+}
+
+void
+chck_slab_release(struct chck_slab *slab)
+{
+   if (!slab || !slab->member)
+      return;
+
+   // deleting key does not run destructors, so we need to reclaim the caches ourselves
+   pthread_key_delete(slab->key);
+
+   while (slab->depot.caches)
+      cache_release(slab->depot.caches);
+
+   magazine_release_list(slab->depot.full);
+   magazine_release_list(slab->depot.empty);
+
+   for (void *s = slab->depot.slabs, *next; s; s = next) {
+      next = *(void**)s;
+      free(s);
+   }
+
+   pthread_mutex_destroy(&slab->depot.mutex);
+   memset(slab, 0, sizeof(struct chck_slab));
+}
+
+bool
+chck_slab(struct chck_slab *slab, size_t member_size, size_t step, size_t rounds)
+{
+   assert(slab && member_size > 0);
+   memset(slab, 0, sizeof(struct chck_slab));
+
+   if (unlikely(!member_size))
+      return false;
+
+   // objects must be able to hold pointer and be aligned
+   slab->member = align(member_size < sizeof(void*) ? sizeof(void*) : member_size);
+
+   // by default aim for 64KiB slabs
+   slab->step = (step ? step : (slab->member < 0x10000 / 32 ? 0x10000 / slab->member : 32));
+   slab->rounds = (rounds ? rounds : 64);
+
+   size_t sz;
+   if (unlikely(chck_mul_ofsz(slab->step, slab->member, &sz)) || unlikely(chck_add_ofsz(sz, align(sizeof(void*)), &sz)))
+      goto fail;
+
+   if (pthread_mutex_init(&slab->depot.mutex, NULL) != 0)
+      goto fail;
+
+   if (pthread_key_create(&slab->key, cache_destructor) != 0) {
+      pthread_mutex_destroy(&slab->depot.mutex);
+      goto fail;
+   }
+
+   return true;
+
+fail:
+   memset(slab, 0, sizeof(struct chck_slab));
+   return false;
+}
@@ -0,0 +1,53 @@
+#ifndef __chck_slab__
+#define __chck_slab__
+
+#include <chck/macros.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+struct chck_slab_magazine;
+struct chck_slab_cache;
+
+struct chck_slab {
+   struct {
+      // magazines that have objects in them and magazines that are empty
+      struct chck_slab_magazine *full, *empty;
+
+      // linked list of slabs, objects are carved from the head slab
+      void *slabs;
+
+      // number of objects carved from the head slab
+      size_t carved;
+
+      // caches of every thread that has used this slab
+      struct chck_slab_cache *caches;
+
+      pthread_mutex_t mutex;
+   } depot;
+
+   // thread local cache key
+   pthread_key_t key;
+
+   // aligned object size, objects per slab and objects per magazine
+   size_t member, step, rounds;
+};
+
+/**
+ * Slabs are allocators for fixed size objects.
+ * Unlike pools, the returned pointers are stable until you free them.
+ *
+ * Each thread has its own cache of two magazines (stacks of free objects), so alloc/free is lock free O(1) most of the time.
+ * The shared depot (and its lock) is only touched when both magazines of the thread run empty (alloc) or full (free).
+ * Objects may be freed from a different thread than they were allocated in.
+ *
+ * Memory is given back to the system only when the slab is released.
+ * Releasing the slab while other threads are still using it is not allowed.
+ */
+
+CHCK_NONULL bool chck_slab(struct chck_slab *slab, size_t member_size, size_t step, size_t rounds);
+void chck_slab_release(struct chck_slab *slab);
+CHCK_NONULL CHCK_MALLOC void* chck_slab_alloc(struct chck_slab *slab);
+CHCK_NONULLV(1) void chck_slab_free(struct chck_slab *slab, void *ptr);
+
+#endif /* __chck_slab__ */
@@ -0,0 +1,149 @@
+#include "slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+struct item {
+   uint32_t a;
+   void *b;
+};
+
+struct worker {
+   struct chck_slab *slab;
+   struct item **items;
+   size_t count;
+};
+
+static void*
+alloc_free_thread(void *arg)
+{
+   struct worker *w = arg;
+
+   for (size_t r = 0; r < 8; ++r) {
+      for (size_t i = 0; i < w->count; ++i) {
+         assert((w->items[i] = chck_slab_alloc(w->slab)));
+         w->items[i]->a = i;
+      }
+
+      for (size_t i = 0; i < w->count; ++i) {
+         assert(w->items[i]->a == i);
+         chck_slab_free(w->slab, w->items[i]);
+      }
+   }
+
+   // leave some objects for the other thread to free
+   for (size_t i = 0; i < w->count; ++i)
+      assert((w->items[i] = chck_slab_alloc(w->slab)));
+
+   return NULL;
+}
+
+static void*
+free_thread(void *arg)
+{
+   struct worker *w = arg;
+
+   for (size_t i = 0; i < w->count; ++i)
+      chck_slab_free(w->slab, w->items[i]);
+
+   return NULL;
+}
+
+int main(void)
+{
+   /* TEST: slab */
+   {
+      struct chck_slab slab;
+      assert(chck_slab(&slab, sizeof(struct item), 16, 4));
+      assert(slab.member >= sizeof(struct item));
+      assert(slab.step == 16 && slab.rounds == 4);
+
+      struct item *items[100];
+      for (size_t i = 0; i < 100; ++i) {
+         assert((items[i] = chck_slab_alloc(&slab)));
+         items[i]->a = i;
+      }
+
+      for (size_t i = 0; i < 100; ++i) {
+         for (size_t j = i + 1; j < 100; ++j)
+            assert(items[i] != items[j]);
+         assert(items[i]->a == i);
+         assert(((uintptr_t)items[i] % sizeof(void*)) == 0);
+      }
+
+      // freed objects are reused
+      struct item *last = items[99];
+      chck_slab_free(&slab, last);
+      assert(chck_slab_alloc(&slab) == last);
+
+      for (size_t i = 0; i < 100; ++i)
+         chck_slab_free(&slab, items[i]);
+
+      chck_slab_free(&slab, NULL);
+      chck_slab_release(&slab);
+      assert(slab.member == 0);
+   }
+
+   /* TEST: slab across threads */
+   {
+      struct chck_slab slab;
+      assert(chck_slab(&slab, sizeof(struct item), 0, 0));
+
+      enum { THREADS = 4, COUNT = 0xFFF };
+      pthread_t threads[THREADS];
+      struct worker workers[THREADS];
+      for (size_t i = 0; i < THREADS; ++i) {
+         workers[i] = (struct worker){ &slab, calloc(COUNT, sizeof(struct item*)), COUNT };
+         assert(workers[i].items);
+         assert(pthread_create(&threads[i], NULL, alloc_free_thread, &workers[i]) == 0);
+      }
+
+      for (size_t i = 0; i < THREADS; ++i)
+         assert(pthread_join(threads[i], NULL) == 0);
+
+      // all live objects must be unique
+      for (size_t i = 0; i < THREADS; ++i) {
+         for (size_t j = 0; j < COUNT; ++j)
+            workers[i].items[j]->a = i * COUNT + j;
+      }
+
+      for (size_t i = 0; i < THREADS; ++i) {
+         for (size_t j = 0; j < COUNT; ++j)
+            assert(workers[i].items[j]->a == i * COUNT + j);
+      }
+
+      // free objects in threads that did not allocate them
+      for (size_t i = 0; i < THREADS; ++i)
+         assert(pthread_create(&threads[i], NULL, free_thread, &workers[(i + 1) % THREADS]) == 0);
+
+      for (size_t i = 0; i < THREADS; ++i)
+         assert(pthread_join(threads[i], NULL) == 0);
+
+      for (size_t i = 0; i < THREADS; ++i)
+         free(workers[i].items);
+
+      chck_slab_release(&slab);
+   }
+
+   /* TEST: benchmark alloc/free */
+   {
+      struct chck_slab slab;
+      assert(chck_slab(&slab, sizeof(struct item), 0, 0));
+
+      const size_t iters = 0xFFFFF;
+      for (size_t i = 0; i < iters; ++i) {
+         void *a, *b;
+         assert((a = chck_slab_alloc(&slab)) && (b = chck_slab_alloc(&slab)));
+         chck_slab_free(&slab, a);
+         chck_slab_free(&slab, b);
+      }
+
+      chck_slab_release(&slab);
+   }
+
+   return EXIT_SUCCESS;
+}
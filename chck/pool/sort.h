@@ -0,0 +1,262 @@
+#ifndef __chck_pool_sort__
+#define __chck_pool_sort__
+
+#include "pool.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * Type specialised sorting and searching for C arrays and IterPools.
+ * Unlike qsort, the comparison is inlined into the generated functions.
+ *
+ * chck_decl_sort(name, T, less) declares:
+ *    void name_sort(T *a, size_t n)                                  pattern defeating quicksort (unstable, O(n log n) worst case)
+ *    size_t name_lower_bound(const T *a, size_t n, const T *key)     index of first item not less than key
+ *    size_t name_upper_bound(const T *a, size_t n, const T *key)     index of first item greater than key
+ *    void name_sort_pool(struct chck_iter_pool *pool)
+ *    size_t name_lower_bound_pool(const struct chck_iter_pool *pool, const T *key)
+ *    size_t name_upper_bound_pool(const struct chck_iter_pool *pool, const T *key)
+ *    bool name_merge(struct chck_iter_pool *out, const struct chck_iter_pool **in, size_t k)   stable k-way merge of sorted pools, appended to out
+ *                                                                                              (out must not be one of in)
+ *
+ * less(a, b) receives two pointers to T and must return true when *a sorts before *b.
+ *
+ * chck_decl_radix_sort(name, T, KT, key) declares:
+ *    bool name_radix_sort(T *a, size_t n)                            LSD radix sort (stable, O(n * sizeof(KT)))
+ *    bool name_radix_sort_pool(struct chck_iter_pool *pool)
+ *
+ * key(a) receives pointer to T and returns the unsigned integer sort key of type KT.
+ * For signed keys, flip the sign bit in key (e.g. (uint32_t)a->i ^ 0x80000000).
+ * Radix sort needs temporary buffer of the same size as input, thus it may fail.
+ */
+
+#define chck_decl_sort(name, T, less) \
+   static inline void name##_swap(T *a, T *b) { T t = *a; *a = *b; *b = t; } \
+   static inline void name##_sort2(T *a, T *b) { if (less(b, a)) name##_swap(a, b); } \
+   static inline void name##_sort3(T *a, T *b, T *c) { name##_sort2(a, b); name##_sort2(b, c); name##_sort2(a, b); } \
+   \
+   static inline void name##_insertion_sort(T *a, size_t n) { \
+      for (size_t i = 1; i < n; ++i) { \
+         if (!less(&a[i], &a[i - 1])) continue; \
+         T t = a[i]; size_t j = i; \
+         do { a[j] = a[j - 1]; --j; } while (j > 0 && less(&t, &a[j - 1])); \
+         a[j] = t; \
+      } \
+   } \
+   \
+   static inline bool name##_partial_insertion_sort(T *a, size_t n) { \
+      size_t moves = 0; \
+      for (size_t i = 1; i < n; ++i) { \
+         if (!less(&a[i], &a[i - 1])) continue; \
+         T t = a[i]; size_t j = i; \
+         do { a[j] = a[j - 1]; --j; } while (j > 0 && less(&t, &a[j - 1])); \
+         a[j] = t; \
+         if ((moves += i - j) > 8) return false; \
+      } \
+      return true; \
+   } \
+   \
+   static inline void name##_sift_down(T *a, size_t i, size_t n) { \
+      for (size_t c; (c = 2 * i + 1) < n; i = c) { \
+         if (c + 1 < n && less(&a[c], &a[c + 1])) ++c; \
+         if (!less(&a[i], &a[c])) return; \
+         name##_swap(&a[i], &a[c]); \
+      } \
+   } \
+   \
+   static inline void name##_heap_sort(T *a, size_t n) { \
+      for (size_t i = n / 2; i > 0; --i) name##_sift_down(a, i - 1, n); \
+      for (size_t i = n; i > 1; --i) { name##_swap(&a[0], &a[i - 1]); name##_sift_down(a, 0, i - 1); } \
+   } \
+   \
+   /* partitions around a[0], items equal to pivot go right */ \
+   static inline size_t name##_partition_right(T *a, size_t n, bool *out_partitioned) { \
+      const T pivot = a[0]; \
+      size_t first = 0, last = n; \
+      while (less(&a[++first], &pivot)); \
+      if (first == 1) { while (first < last && !less(&a[--last], &pivot)); } \
+      else { while (!less(&a[--last], &pivot)); } \
+      *out_partitioned = (first >= last); \
+      while (first < last) { \
+         name##_swap(&a[first], &a[last]); \
+         while (less(&a[++first], &pivot)); \
+         while (!less(&a[--last], &pivot)); \
+      } \
+      a[0] = a[first - 1]; a[first - 1] = pivot; \
+      return first - 1; \
+   } \
+   \
+   /* partitions around a[0], items equal to pivot go left */ \
+   static inline size_t name##_partition_left(T *a, size_t n) { \
+      const T pivot = a[0]; \
+      size_t first = 0, last = n; \
+      while (less(&pivot, &a[--last])); \
+      if (last + 1 == n) { while (first < last && !less(&pivot, &a[++first])); } \
+      else { while (!less(&pivot, &a[++first])); } \
+      while (first < last) { \
+         name##_swap(&a[first], &a[last]); \
+         while (less(&pivot, &a[--last])); \
+         while (!less(&pivot, &a[++first])); \
+      } \
+      a[0] = a[last]; a[last] = pivot; \
+      return last; \
+   } \
+   \
+   static inline void name##_pdqsort(T *a, size_t n, unsigned int bad_allowed, bool leftmost) { \
+      while (n >= 24) { \
+         const size_t s2 = n / 2; \
+         if (n > 128) { \
+            name##_sort3(&a[0], &a[s2], &a[n - 1]); \
+            name##_sort3(&a[1], &a[s2 - 1], &a[n - 2]); \
+            name##_sort3(&a[2], &a[s2 + 1], &a[n - 3]); \
+            name##_sort3(&a[s2 - 1], &a[s2], &a[s2 + 1]); \
+            name##_swap(&a[0], &a[s2]); \
+         } else { \
+            name##_sort3(&a[s2], &a[0], &a[n - 1]); \
+         } \
+         /* previous pivot is equal to this one, skip all the equal items */ \
+         if (!leftmost && !less(&a[-1], &a[0])) { \
+            const size_t p = name##_partition_left(a, n); \
+            a += p + 1; n -= p + 1; \
+            continue; \
+         } \
+         bool partitioned; \
+         const size_t p = name##_partition_right(a, n, &partitioned); \
+         const size_t l = p, r = n - p - 1; \
+         if (l < n / 8 || r < n / 8) { \
+            /* bad partition, fall back to heap sort if it keeps happening, otherwise break patterns */ \
+            if (--bad_allowed == 0) { name##_heap_sort(a, n); return; } \
+            if (l >= 24) { \
+               name##_swap(&a[0], &a[l / 4]); \
+               name##_swap(&a[p - 1], &a[p - l / 4]); \
+               if (l > 128) { \
+                  name##_swap(&a[1], &a[l / 4 + 1]); name##_swap(&a[2], &a[l / 4 + 2]); \
+                  name##_swap(&a[p - 2], &a[p - (l / 4 + 1)]); name##_swap(&a[p - 3], &a[p - (l / 4 + 2)]); \
+               } \
+            } \
+            if (r >= 24) { \
+               name##_swap(&a[p + 1], &a[p + 1 + r / 4]); \
+               name##_swap(&a[n - 1], &a[n - r / 4]); \
+               if (r > 128) { \
+                  name##_swap(&a[p + 2], &a[p + 2 + r / 4]); name##_swap(&a[p + 3], &a[p + 3 + r / 4]); \
+                  name##_swap(&a[n - 2], &a[n - (1 + r / 4)]); name##_swap(&a[n - 3], &a[n - (2 + r / 4)]); \
+               } \
+            } \
+         } else if (partitioned && name##_partial_insertion_sort(a, l) && name##_partial_insertion_sort(&a[p + 1], r)) { \
+            return; \
+         } \
+         name##_pdqsort(a, l, bad_allowed, leftmost); \
+         a += p + 1; n = r; leftmost = false; \
+      } \
+      name##_insertion_sort(a, n); \
+   } \
+   \
+   static inline void name##_sort(T *a, size_t n) { \
+      unsigned int log2 = 1; \
+      for (size_t i = n; i > 1; i >>= 1) ++log2; \
+      name##_pdqsort(a, n, log2, true); \
+   } \
+   \
+   static inline size_t name##_lower_bound(const T *a, size_t n, const T *key) { \
+      size_t lo = 0; \
+      while (n > 0) { \
+         const size_t half = n / 2; \
+         if (less(&a[lo + half], key)) { lo += half + 1; n -= half + 1; } else { n = half; } \
+      } \
+      return lo; \
+   } \
+   \
+   static inline size_t name##_upper_bound(const T *a, size_t n, const T *key) { \
+      size_t lo = 0; \
+      while (n > 0) { \
+         const size_t half = n / 2; \
+         if (!less(key, &a[lo + half])) { lo += half + 1; n -= half + 1; } else { n = half; } \
+      } \
+      return lo; \
+   } \
+   \
+   static inline void name##_sort_pool(struct chck_iter_pool *pool) { \
+      assert(pool->items.member == sizeof(T)); \
+      name##_sort(pool->items.buffer, pool->items.count); \
+   } \
+   \
+   static inline size_t name##_lower_bound_pool(const struct chck_iter_pool *pool, const T *key) { \
+      assert(pool->items.member == sizeof(T)); \
+      return name##_lower_bound(pool->items.buffer, pool->items.count, key); \
+   } \
+   \
+   static inline size_t name##_upper_bound_pool(const struct chck_iter_pool *pool, const T *key) { \
+      assert(pool->items.member == sizeof(T)); \
+      return name##_upper_bound(pool->items.buffer, pool->items.count, key); \
+   } \
+   \
+   /* heap of source indices, ties are broken by source index to keep the merge stable */ \
+   static inline bool name##_merge_less(const struct chck_iter_pool **in, const size_t *pos, size_t a, size_t b) { \
+      const T *x = (const T*)in[a]->items.buffer + pos[a], *y = (const T*)in[b]->items.buffer + pos[b]; \
+      return less(x, y) || (!less(y, x) && a < b); \
+   } \
+   \
+   static inline void name##_merge_sift(const struct chck_iter_pool **in, const size_t *pos, size_t *heap, size_t i, size_t n) { \
+      for (size_t c; (c = 2 * i + 1) < n; i = c) { \
+         if (c + 1 < n && name##_merge_less(in, pos, heap[c + 1], heap[c])) ++c; \
+         if (!name##_merge_less(in, pos, heap[c], heap[i])) return; \
+         const size_t t = heap[i]; heap[i] = heap[c]; heap[c] = t; \
+      } \
+   } \
+   \
+   static inline bool name##_merge(struct chck_iter_pool *out, const struct chck_iter_pool **in, size_t k) { \
+      assert(out->items.member == sizeof(T)); \
+      size_t *pos, *heap, n = 0, total = 0; \
+      if (!(pos = chck_calloc_of(k * 2 + 1, sizeof(size_t)))) return false; \
+      heap = pos + k; \
+      for (size_t i = 0; i < k; ++i) { \
+         assert(in[i]->items.member == sizeof(T) && in[i] != out); \
+         if (unlikely(in[i] == out)) { free(pos); return false; } \
+         total += in[i]->items.count; \
+         if (in[i]->items.count > 0) heap[n++] = i; \
+      } \
+      if (!chck_iter_pool_reserve(out, out->items.count + total)) { free(pos); return false; } \
+      for (size_t i = n / 2; i > 0; --i) name##_merge_sift(in, pos, heap, i - 1, n); \
+      while (n > 0) { \
+         const size_t s = heap[0]; \
+         chck_iter_pool_push_back(out, (const T*)in[s]->items.buffer + pos[s]); \
+         if (++pos[s] >= in[s]->items.count) heap[0] = heap[--n]; \
+         name##_merge_sift(in, pos, heap, 0, n); \
+      } \
+      free(pos); \
+      return true; \
+   }
+
+#define chck_decl_radix_sort(name, T, KT, key) \
+   static inline bool name##_radix_sort(T *a, size_t n) { \
+      if (n < 2) return true; \
+      T *tmp; \
+      if (!(tmp = chck_malloc_mul_of(n, sizeof(T)))) return false; \
+      size_t counts[sizeof(KT)][256]; \
+      memset(counts, 0, sizeof(counts)); \
+      for (size_t i = 0; i < n; ++i) { \
+         const KT k = key(&a[i]); \
+         for (size_t d = 0; d < sizeof(KT); ++d) ++counts[d][(k >> (d * 8)) & 0xff]; \
+      } \
+      T *src = a, *dst = tmp; \
+      for (size_t d = 0; d < sizeof(KT); ++d) { \
+         /* every key has same digit, nothing to do on this pass */ \
+         if (counts[d][(key(&src[0]) >> (d * 8)) & 0xff] == n) continue; \
+         size_t offset = 0; \
+         for (size_t b = 0; b < 256; ++b) { const size_t c = counts[d][b]; counts[d][b] = offset; offset += c; } \
+         for (size_t i = 0; i < n; ++i) dst[counts[d][(key(&src[i]) >> (d * 8)) & 0xff]++] = src[i]; \
+         T *t = src; src = dst; dst = t; \
+      } \
+      if (src != a) memcpy(a, src, n * sizeof(T)); \
+      free(tmp); \
+      return true; \
+   } \
+   \
+   static inline bool name##_radix_sort_pool(struct chck_iter_pool *pool) { \
+      assert(pool->items.member == sizeof(T)); \
+      return name##_radix_sort(pool->items.buffer, pool->items.count); \
+   }
+
+#endif /* __chck_pool_sort__ */
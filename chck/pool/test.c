@@ -1,4 +1,5 @@
 #include "pool.h"
+#include "sort.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,6 +18,25 @@ static void printa(struct item *item)
    printf("item::%d\n", item->a);
 }
 
+#define item_less(x, y) ((x)->a < (y)->a)
+#define item_key(x) ((x)->a)
+chck_decl_sort(item, struct item, item_less)
+chck_decl_radix_sort(item, struct item, uint32_t, item_key)
+
+static bool is_sorted(const struct item *items, size_t memb)
+{
+   for (size_t i = 1; i < memb; ++i)
+      if (items[i].a < items[i - 1].a)
+         return false;
+   return true;
+}
+
+static bool is_odd(void *item, void *userdata)
+{
+   (void)userdata;
+   return (((struct item*)item)->a % 2);
+}
+
 int main(void)
 {
    struct item dummy = {0};
@@ -302,6 +322,164 @@ int main(void)
       assert(pool.items.used == 0);
    }
 
+   /* TEST: iter pool unordered removal */
+   {
+      struct chck_iter_pool pool;
+      assert(chck_iter_pool(&pool, 4, 0, sizeof(struct item)));
+
+      for (uint32_t i = 0; i < 10; ++i)
+         assert(chck_iter_pool_push_back(&pool, (&(struct item){i, NULL})));
+
+      chck_iter_pool_remove_unordered(&pool, 2);
+      assert(pool.items.count == 9);
+      assert(((struct item*)chck_iter_pool_get(&pool, 2))->a == 9);
+      assert(((struct item*)chck_iter_pool_get_last(&pool))->a == 8);
+
+      chck_iter_pool_remove_unordered(&pool, pool.items.count - 1);
+      assert(pool.items.count == 8);
+      assert(((struct item*)chck_iter_pool_get_last(&pool))->a == 7);
+      chck_iter_pool_remove_unordered(&pool, 55);
+      assert(pool.items.count == 8);
+
+      // 0, 1, 9, 3, 4, 5, 6, 7
+      chck_iter_pool_retain_if(&pool, is_odd, NULL);
+      assert(pool.items.count == 5);
+      assert(pool.items.used == 5 * sizeof(struct item));
+      assert(pool.items.allocated == 8 * sizeof(struct item));
+
+      {
+         uint32_t expect[] = { 1, 9, 3, 5, 7 }, i = 0;
+         struct item *current;
+         chck_iter_pool_for_each(&pool, current)
+            assert(current->a == expect[i++]);
+         assert(i == 5);
+      }
+
+      for (uint32_t i = 0; i < 100; ++i)
+         assert(chck_iter_pool_push_back(&pool, (&(struct item){i * 2, NULL})));
+      chck_iter_pool_retain_if(&pool, is_odd, NULL);
+      assert(pool.items.count == 5);
+      assert(pool.items.allocated == 8 * sizeof(struct item));
+
+      chck_iter_pool_release(&pool);
+   }
+
+   /* TEST: benchmark (unordered removal from the middle) */
+   {
+      const uint32_t iters = 0xFFFFF;
+      struct chck_iter_pool pool;
+      assert(chck_iter_pool(&pool, 32, iters, sizeof(struct item)));
+      for (uint32_t i = 0; i < iters; ++i)
+         assert(chck_iter_pool_push_back(&pool, (&(struct item){i, NULL})));
+      while (pool.items.count > 0)
+         chck_iter_pool_remove_unordered(&pool, pool.items.count / 2);
+      assert(pool.items.used == 0);
+      chck_iter_pool_release(&pool);
+   }
+
+   /* TEST: iter pool sorting, searching and merging */
+   {
+      const size_t memb = 0xFFFF;
+      struct chck_iter_pool pool;
+      assert(chck_iter_pool(&pool, 32, memb, sizeof(struct item)));
+
+      // random, few unique, sorted, reverse sorted and sawtooth inputs
+      for (uint32_t pattern = 0; pattern < 5; ++pattern) {
+         for (size_t radix = 0; radix < 2; ++radix) {
+            chck_iter_pool_empty(&pool);
+
+            uint64_t sum = 0;
+            for (uint32_t i = 0, v = 1; i < memb; ++i) {
+               v = v * 1103515245 + 12345;
+               const uint32_t values[] = { v >> 4, (v >> 16) % 4, i, memb - i, i % 100 };
+               assert(chck_iter_pool_push_back(&pool, (&(struct item){values[pattern], (void*)(uintptr_t)i})));
+               sum += values[pattern];
+            }
+
+            if (radix) {
+               assert(item_radix_sort_pool(&pool));
+            } else {
+               item_sort_pool(&pool);
+            }
+
+            assert(pool.items.count == memb);
+            assert(is_sorted(pool.items.buffer, pool.items.count));
+
+            struct item *current;
+            chck_iter_pool_for_each(&pool, current)
+               sum -= current->a;
+            assert(sum == 0);
+
+            // radix sort is stable
+            if (radix) {
+               struct item *items = pool.items.buffer;
+               for (size_t i = 1; i < memb; ++i)
+                  assert(items[i - 1].a != items[i].a || items[i - 1].b < items[i].b);
+            }
+         }
+      }
+
+      // pool now contains 0..99 repeating, sorted
+      {
+         size_t less = 0, equal = 0;
+         for (size_t i = 0; i < memb; ++i) {
+            less += (i % 100 < 50);
+            equal += (i % 100 == 50);
+         }
+         assert(item_lower_bound_pool(&pool, &(struct item){50, NULL}) == less);
+         assert(item_upper_bound_pool(&pool, &(struct item){50, NULL}) == less + equal);
+      }
+      assert(item_lower_bound_pool(&pool, &(struct item){0, NULL}) == 0);
+      assert(item_upper_bound_pool(&pool, &(struct item){100, NULL}) == memb);
+
+      struct item small[] = { {5, NULL}, {3, NULL}, {1, NULL} };
+      item_sort(small, 3);
+      assert(small[0].a == 1 && small[1].a == 3 && small[2].a == 5);
+      assert(item_lower_bound(small, 3, &(struct item){2, NULL}) == 1);
+      assert(item_lower_bound(small, 0, &(struct item){2, NULL}) == 0);
+
+      struct chck_iter_pool a, b, c, out;
+      assert(chck_iter_pool_from_c_array(&a, (struct item[]){ {1, (void*)1}, {4, NULL}, {7, NULL} }, 3, 32, sizeof(struct item)));
+      assert(chck_iter_pool_from_c_array(&b, (struct item[]){ {1, (void*)2}, {2, NULL}, {9, NULL}, {10, NULL} }, 4, 32, sizeof(struct item)));
+      assert(chck_iter_pool(&c, 32, 0, sizeof(struct item)));
+      assert(chck_iter_pool(&out, 32, 0, sizeof(struct item)));
+      assert(item_merge(&out, (const struct chck_iter_pool*[]){ &a, &b, &c }, 3));
+      assert(out.items.count == 7);
+      assert(is_sorted(out.items.buffer, out.items.count));
+      assert(((struct item*)chck_iter_pool_get(&out, 0))->b == (void*)1);
+      assert(((struct item*)chck_iter_pool_get(&out, 1))->b == (void*)2);
+      assert(((struct item*)chck_iter_pool_get_last(&out))->a == 10);
+
+      chck_iter_pool_release(&a);
+      chck_iter_pool_release(&b);
+      chck_iter_pool_release(&c);
+      chck_iter_pool_release(&out);
+      chck_iter_pool_release(&pool);
+   }
+
+   /* TEST: benchmark (sorting large pools) */
+   {
+      const size_t memb = 0xFFFFF;
+      struct chck_iter_pool pool;
+      assert(chck_iter_pool(&pool, 32, memb, sizeof(struct item)));
+      for (size_t radix = 0; radix < 2; ++radix) {
+         chck_iter_pool_empty(&pool);
+         for (uint32_t i = 0, v = 1; i < memb; ++i) {
+            v = v * 1103515245 + 12345;
+            assert(chck_iter_pool_push_back(&pool, (&(struct item){v, NULL})));
+         }
+
+         if (radix) {
+            assert(item_radix_sort_pool(&pool));
+         } else {
+            item_sort_pool(&pool);
+         }
+
+         assert(is_sorted(pool.items.buffer, pool.items.count));
+      }
+      chck_iter_pool_release(&pool);
+   }
+
    /* TEST: ring pool */
    {
       struct chck_ring_pool pool;
@@ -418,6 +596,119 @@ int main(void)
       assert(pool.items.used == 0);
    }
 
+   /* TEST: chunk pool */
+   {
+      struct chck_chunk_pool pool;
+      assert(chck_chunk_pool(&pool, 32, 4, sizeof(struct item)));
+
+      assert(!chck_chunk_pool_get(&pool, 0));
+      assert(!chck_chunk_pool_get_last(&pool));
+      assert(chck_chunk_pool_push_back(&pool, (&(struct item){1, NULL})));
+      assert(chck_chunk_pool_push_back(&pool, (&(struct item){2, NULL})));
+      chck_chunk_pool_remove(&pool, 0);
+      assert(((struct item*)chck_chunk_pool_get(&pool, 0))->a == 2);
+      chck_chunk_pool_flush(&pool);
+      assert(pool.count == 0 && pool.chunks.count == 0);
+
+      assert(chck_chunk_pool_push_front(&pool, (&(struct item){1, NULL})));
+      assert(chck_chunk_pool_insert(&pool, 55, (&(struct item){2, NULL}))); // same as push_back when index > count
+      assert(chck_chunk_pool_insert(&pool, 1, (&(struct item){3, NULL})));
+      assert(((struct item*)chck_chunk_pool_get(&pool, 0))->a == 1);
+      assert(((struct item*)chck_chunk_pool_get(&pool, 1))->a == 3);
+      assert(((struct item*)chck_chunk_pool_get(&pool, 2))->a == 2);
+      assert(((struct item*)chck_chunk_pool_get_last(&pool))->a == 2);
+
+      // fill over multiple chunks, and insert to the middle of full chunks
+      for (uint32_t i = 4; i < 16; ++i)
+         assert(chck_chunk_pool_push_back(&pool, (&(struct item){i, NULL})));
+      assert(chck_chunk_pool_insert(&pool, 6, (&(struct item){100, NULL})));
+      assert(chck_chunk_pool_insert(&pool, 0, (&(struct item){101, NULL})));
+      assert(pool.count == 17 && pool.chunks.count > 4);
+      assert(((struct item*)chck_chunk_pool_get(&pool, 0))->a == 101);
+      assert(((struct item*)chck_chunk_pool_get(&pool, 7))->a == 100);
+      assert(((struct item*)chck_chunk_pool_get_last(&pool))->a == 15);
+
+      {
+         size_t iter = 0, i = 0;
+         struct item *current;
+         while ((current = chck_chunk_pool_iter(&pool, &iter, false)))
+            assert(current == chck_chunk_pool_get(&pool, i++));
+         assert(i == 17);
+      }
+
+      {
+         size_t iter = pool.chunks.count * pool.chunk - 1, i = pool.count;
+         struct item *current;
+         while ((current = chck_chunk_pool_iter(&pool, &iter, true)))
+            assert(current == chck_chunk_pool_get(&pool, --i));
+         assert(i == 0 && iter == (size_t)-1);
+      }
+
+      {
+         size_t i = pool.count;
+         struct item *current;
+         chck_chunk_pool_for_each_reverse(&pool, current)
+            assert(current == chck_chunk_pool_get(&pool, --i));
+         assert(i == 0);
+      }
+
+      chck_chunk_pool_remove(&pool, 7);
+      chck_chunk_pool_remove(&pool, 0);
+      chck_chunk_pool_remove(&pool, 55);
+      assert(pool.count == 15);
+
+      {
+         uint32_t expect[] = { 1, 3, 2, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 }, i = 0;
+         struct item *current;
+         chck_chunk_pool_for_each(&pool, current)
+            assert(current->a == expect[i++]);
+         assert(i == 15);
+      }
+
+      while (pool.count > 0)
+         chck_chunk_pool_remove(&pool, pool.count / 2);
+      assert(pool.chunks.count == 0);
+      chck_chunk_pool_release(&pool);
+
+      uint32_t arr[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+      assert(chck_chunk_pool_from_c_array(&pool, arr, 9, 32, 4, sizeof(uint32_t)));
+      assert(pool.count == 9 && pool.chunks.count == 3);
+      for (uint32_t i = 0; i < 9; ++i)
+         assert(*(uint32_t*)chck_chunk_pool_get(&pool, i) == arr[i]);
+
+      chck_chunk_pool_release(&pool);
+      assert(pool.chunks.allocated == 0);
+      assert(pool.count == 0);
+   }
+
+   /* TEST: benchmark (sorted insertion and removal from the middle of chunk pool) */
+   {
+      const uint32_t iters = 0x1FFFF;
+      struct chck_chunk_pool pool;
+      assert(chck_chunk_pool(&pool, 32, 0, sizeof(uint32_t)));
+      for (uint32_t i = 0, v = 1; i < iters; ++i) {
+         v = v * 1103515245 + 12345;
+         const uint32_t key = v >> 8;
+         size_t lo = 0, hi = pool.count;
+         while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (*(uint32_t*)chck_chunk_pool_get(&pool, mid) < key) lo = mid + 1; else hi = mid;
+         }
+         assert(chck_chunk_pool_insert(&pool, lo, &key));
+      }
+      assert(pool.count == iters);
+      {
+         uint32_t last = 0, *current;
+         chck_chunk_pool_for_each(&pool, current) {
+            assert(last <= *current);
+            last = *current;
+         }
+      }
+      while (pool.count > 0)
+         chck_chunk_pool_remove(&pool, pool.count / 2);
+      chck_chunk_pool_release(&pool);
+   }
+
    /* TEST: benchmark (many insertions, and removal expanding from center) */
    {
       const uint32_t iters = 0xFFFFF;
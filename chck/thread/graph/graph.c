@@ -0,0 +1,238 @@
+#include "graph.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static void work(struct chck_graph_node **data);
+
+static struct chck_graph_node*
+schedule(struct chck_graph *graph, struct chck_graph_node *ready, bool block)
+{
+   assert(graph);
+
+   // returns the nodes that did not fit in the queue
+   struct chck_graph_node *inline_list = NULL;
+   for (struct chck_graph_node *node = ready, *next; node; node = next) {
+      next = node->next;
+
+      if (chck_tqueue_add_task(&graph->tqueue, &node, block))
+         continue;
+
+      node->next = inline_list;
+      inline_list = node;
+   }
+
+   return inline_list;
+}
+
+static struct chck_graph_node*
+complete(struct chck_graph_node *node)
+{
+   assert(node);
+   struct chck_graph *graph = node->graph;
+
+   // no more dependents after this
+   pthread_mutex_lock(&graph->mutex);
+   node->sealed = true;
+   pthread_mutex_unlock(&graph->mutex);
+
+   struct chck_graph_node *ready = NULL;
+   for (size_t i = 0; i < node->ndependents; ++i) {
+      struct chck_graph_node *dependent = node->dependents[i];
+
+      if (__atomic_sub_fetch(&dependent->pending, 1, __ATOMIC_ACQ_REL))
+         continue;
+
+      dependent->next = ready;
+      ready = dependent;
+   }
+
+   // node may be released after this, so do it last
+   pthread_mutex_lock(&graph->mutex);
+   node->done = true;
+   --graph->pending;
+   if (graph->waiters)
+      pthread_cond_broadcast(&graph->notify);
+   pthread_mutex_unlock(&graph->mutex);
+
+   // we are on worker, so the queue can't be waited for
+   return schedule(graph, ready, false);
+}
+
+static void
+work(struct chck_graph_node **data)
+{
+   assert(data && *data);
+   struct chck_graph_node *node = *data;
+   struct chck_graph *graph = node->graph;
+
+   struct chck_graph_node *inline_list = NULL;
+   while (node) {
+      node->function(node);
+
+      // nodes that did not fit in the queue are ran here
+      for (struct chck_graph_node *more = complete(node), *next; more; more = next) {
+         next = more->next;
+         more->next = inline_list;
+         inline_list = more;
+      }
+
+      if ((node = inline_list))
+         inline_list = node->next;
+   }
+
+   // free the slots of finished tasks, so dependents don't have to run inline
+   chck_tqueue_collect_completed(&graph->tqueue);
+}
+
+bool
+chck_graph_depend(struct chck_graph_node *node, struct chck_graph_node *dependency)
+{
+   assert(node && dependency && node->graph == dependency->graph);
+   struct chck_graph *graph = node->graph;
+
+   pthread_mutex_lock(&graph->mutex);
+
+   // already finished, nothing to wait for
+   if (dependency->sealed) {
+      pthread_mutex_unlock(&graph->mutex);
+      return true;
+   }
+
+   if (dependency->ndependents >= dependency->size) {
+      const size_t size = (dependency->size ? dependency->size * 2 : 4);
+
+      // chck_realloc_mul_of does not take NULL
+      size_t sz;
+      void *tmp = NULL;
+      if (unlikely(chck_mul_ofsz(size, sizeof(struct chck_graph_node*), &sz)) || !(tmp = realloc(dependency->dependents, sz))) {
+         pthread_mutex_unlock(&graph->mutex);
+         return false;
+      }
+
+      dependency->dependents = tmp;
+      dependency->size = size;
+   }
+
+   dependency->dependents[dependency->ndependents++] = node;
+   __atomic_add_fetch(&node->pending, 1, __ATOMIC_RELAXED);
+   pthread_mutex_unlock(&graph->mutex);
+   return true;
+}
+
+void
+chck_graph_submit(struct chck_graph_node *node)
+{
+   assert(node && node->graph);
+   struct chck_graph *graph = node->graph;
+
+   pthread_mutex_lock(&graph->mutex);
+   ++graph->pending;
+   pthread_mutex_unlock(&graph->mutex);
+
+   // drop the submit reference, last reference schedules the node
+   if (__atomic_sub_fetch(&node->pending, 1, __ATOMIC_ACQ_REL))
+      return;
+
+   // not on worker, so we can wait for room in the queue
+   node->next = NULL;
+   struct chck_graph_node *inline_list;
+   if ((inline_list = schedule(graph, node, true)))
+      work(&inline_list);
+}
+
+void
+chck_graph_wait(struct chck_graph_node *node)
+{
+   assert(node && node->graph);
+   struct chck_graph *graph = node->graph;
+
+   chck_tqueue_collect_completed(&graph->tqueue);
+
+   pthread_mutex_lock(&graph->mutex);
+   ++graph->waiters;
+   while (!node->done)
+      pthread_cond_wait(&graph->notify, &graph->mutex);
+   --graph->waiters;
+   pthread_mutex_unlock(&graph->mutex);
+}
+
+void
+chck_graph_wait_all(struct chck_graph *graph)
+{
+   assert(graph);
+
+   chck_tqueue_collect_completed(&graph->tqueue);
+
+   pthread_mutex_lock(&graph->mutex);
+   ++graph->waiters;
+   while (graph->pending)
+      pthread_cond_wait(&graph->notify, &graph->mutex);
+   --graph->waiters;
+   pthread_mutex_unlock(&graph->mutex);
+}
+
+void
+chck_graph_node(struct chck_graph_node *node, struct chck_graph *graph, void (*function)(struct chck_graph_node *node))
+{
+   assert(node && graph && function);
+
+   // keep the dependents buffer, if node is reused
+   struct chck_graph_node **dependents = node->dependents;
+   const size_t size = node->size;
+
+   memset(node, 0, sizeof(struct chck_graph_node));
+   node->function = function;
+   node->graph = graph;
+   node->pending = 1;
+   node->dependents = dependents;
+   node->size = size;
+}
+
+void
+chck_graph_node_release(struct chck_graph_node *node)
+{
+   if (!node)
+      return;
+
+   free(node->dependents);
+   memset(node, 0, sizeof(struct chck_graph_node));
+}
+
+void
+chck_graph_release(struct chck_graph *graph)
+{
+   if (!graph)
+      return;
+
+   chck_tqueue_release(&graph->tqueue);
+   pthread_cond_destroy(&graph->notify);
+   pthread_mutex_destroy(&graph->mutex);
+   memset(graph, 0, sizeof(struct chck_graph));
+}
+
+bool
+chck_graph(struct chck_graph *graph, size_t nthreads, size_t qsize)
+{
+   assert(graph && nthreads > 0);
+   memset(graph, 0, sizeof(struct chck_graph));
+
+   if (unlikely(!nthreads))
+      return false;
+
+   if (!chck_tqueue(&graph->tqueue, nthreads, qsize, sizeof(struct chck_graph_node*), work, NULL, NULL))
+      return false;
+
+   // workers and waiters reclaim the slots, and the workers stay around
+   chck_tqueue_set_keep_alive(&graph->tqueue, true, 0);
+
+   if (!chck_tqueue_set_completion(&graph->tqueue, true) || !chck_tqueue_start(&graph->tqueue)) {
+      chck_tqueue_release(&graph->tqueue);
+      return false;
+   }
+
+   pthread_mutex_init(&graph->mutex, NULL);
+   pthread_cond_init(&graph->notify, NULL);
+   return true;
+}
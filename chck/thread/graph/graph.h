@@ -0,0 +1,61 @@
+#ifndef __chck_graph__
+#define __chck_graph__
+
+#include <chck/macros.h>
+#include <chck/thread/queue/queue.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+struct chck_graph;
+
+struct chck_graph_node {
+   void (*function)(struct chck_graph_node *node);
+   struct chck_graph *graph;
+
+   // nodes that wait for this node
+   struct chck_graph_node **dependents;
+   size_t ndependents, size;
+
+   // unfinished dependencies, + 1 until the node is submitted
+   size_t pending;
+
+   // link for nodes that are ran inline
+   struct chck_graph_node *next;
+
+   // sealed when node has finished and no more dependents can be added, done when dependents have been scheduled
+   bool sealed, done;
+};
+
+struct chck_graph {
+   struct chck_tqueue tqueue;
+
+   // nodes submitted but not done, and threads waiting for nodes
+   size_t pending, waiters;
+   pthread_mutex_t mutex;
+   pthread_cond_t notify;
+};
+
+/**
+ * Task graph on top of chck_tqueue.
+ * Nodes run function(node) once all their dependencies are done, finishing node enqueues its dependents directly from the worker thread.
+ * If the queue is full, the dependents are ran on the worker inline instead.
+ *
+ * Nodes are intrusive, embed chck_graph_node in your own struct, and keep it alive until it's done.
+ * Dependencies may be added to a node until it's submitted, dependency itself may be in any state (also already done).
+ * chck_graph_wait waits for single node (future), chck_graph_wait_all for everything submitted (latch).
+ * Don't wait from inside the node functions, the workers could all end up waiting.
+ *
+ * Nodes may be submitted and waited from any thread, the graph must be created and released on same thread.
+ */
+
+CHCK_NONULL bool chck_graph(struct chck_graph *graph, size_t nthreads, size_t qsize);
+void chck_graph_release(struct chck_graph *graph);
+CHCK_NONULL void chck_graph_node(struct chck_graph_node *node, struct chck_graph *graph, void (*function)(struct chck_graph_node *node));
+void chck_graph_node_release(struct chck_graph_node *node);
+CHCK_NONULL bool chck_graph_depend(struct chck_graph_node *node, struct chck_graph_node *dependency);
+CHCK_NONULL void chck_graph_submit(struct chck_graph_node *node);
+CHCK_NONULL void chck_graph_wait(struct chck_graph_node *node);
+CHCK_NONULL void chck_graph_wait_all(struct chck_graph *graph);
+
+#endif /* __chck_graph__ */
@@ -0,0 +1,193 @@
+#include "graph.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+struct step {
+   struct chck_graph_node node;
+   struct step *input[2];
+   size_t ninputs;
+   uint64_t value;
+};
+
+static void
+run(struct chck_graph_node *node)
+{
+   struct step *step = (struct step*)node;
+
+   step->value = 1;
+   for (size_t i = 0; i < step->ninputs; ++i)
+      step->value += step->input[i]->value;
+}
+
+static void
+nap(struct chck_graph_node *node)
+{
+   usleep(2000);
+   run(node);
+}
+
+struct fan {
+   struct step *steps;
+   size_t count;
+};
+
+static void*
+submitter(void *arg)
+{
+   struct fan *fan = arg;
+   for (size_t i = 0; i < fan->count; ++i)
+      chck_graph_submit(&fan->steps[i].node);
+
+   chck_graph_wait_all(fan->steps[0].node.graph);
+   return NULL;
+}
+
+int main(void)
+{
+   /* TEST: diamond */
+   {
+      struct chck_graph graph;
+      assert(chck_graph(&graph, 4, 8));
+
+      struct step steps[4];
+      memset(steps, 0, sizeof(steps));
+      for (size_t i = 0; i < 4; ++i)
+         chck_graph_node(&steps[i].node, &graph, run);
+
+      // 0 -> 1, 2 -> 3
+      steps[1].input[0] = &steps[0]; steps[1].ninputs = 1;
+      steps[2].input[0] = &steps[0]; steps[2].ninputs = 1;
+      steps[3].input[0] = &steps[1]; steps[3].input[1] = &steps[2]; steps[3].ninputs = 2;
+
+      for (size_t i = 0; i < 4; ++i) {
+         for (size_t d = 0; d < steps[i].ninputs; ++d)
+            assert(chck_graph_depend(&steps[i].node, &steps[i].input[d]->node));
+      }
+
+      // submit in reverse, nothing runs before its dependencies
+      for (size_t i = 4; i > 0; --i)
+         chck_graph_submit(&steps[i - 1].node);
+
+      chck_graph_wait(&steps[3].node);
+      assert(steps[0].value == 1 && steps[1].value == 2 && steps[2].value == 2 && steps[3].value == 5);
+
+      // depending on finished node does not wait
+      struct step late;
+      memset(&late, 0, sizeof(late));
+      chck_graph_node(&late.node, &graph, run);
+      late.input[0] = &steps[3]; late.ninputs = 1;
+      assert(chck_graph_depend(&late.node, &steps[3].node));
+      chck_graph_submit(&late.node);
+      chck_graph_wait(&late.node);
+      assert(late.value == 6);
+
+      // nodes can be reused
+      chck_graph_node(&late.node, &graph, run);
+      late.ninputs = 0;
+      chck_graph_submit(&late.node);
+      chck_graph_wait_all(&graph);
+      assert(late.value == 1);
+
+      chck_graph_node_release(&late.node);
+      for (size_t i = 0; i < 4; ++i)
+         chck_graph_node_release(&steps[i].node);
+      chck_graph_release(&graph);
+   }
+
+   /* TEST: wide fan out, more ready nodes than the queue holds */
+   {
+      struct chck_graph graph;
+      assert(chck_graph(&graph, 3, 4));
+
+      const size_t count = 1000;
+      struct step *steps;
+      assert((steps = calloc(count + 2, sizeof(struct step))));
+
+      struct step *root = &steps[count], *sink = &steps[count + 1];
+      chck_graph_node(&root->node, &graph, run);
+      chck_graph_node(&sink->node, &graph, run);
+
+      for (size_t i = 0; i < count; ++i) {
+         chck_graph_node(&steps[i].node, &graph, run);
+         steps[i].input[0] = root; steps[i].ninputs = 1;
+         assert(chck_graph_depend(&steps[i].node, &root->node));
+         assert(chck_graph_depend(&sink->node, &steps[i].node));
+      }
+
+      for (size_t i = 0; i < count; ++i)
+         chck_graph_submit(&steps[i].node);
+
+      chck_graph_submit(&sink->node);
+      chck_graph_submit(&root->node);
+      chck_graph_wait_all(&graph);
+
+      assert(sink->value == 1);
+      for (size_t i = 0; i < count; ++i)
+         assert(steps[i].value == 2);
+
+      for (size_t i = 0; i < count + 2; ++i)
+         chck_graph_node_release(&steps[i].node);
+      free(steps);
+      chck_graph_release(&graph);
+   }
+
+   /* TEST: wide fan out submitted from other thread */
+   {
+      struct chck_graph graph;
+      assert(chck_graph(&graph, 4, 4));
+
+      struct fan fan = { .count = 200 };
+      assert((fan.steps = calloc(fan.count, sizeof(struct step))));
+      for (size_t i = 0; i < fan.count; ++i)
+         chck_graph_node(&fan.steps[i].node, &graph, nap);
+
+      // producer is not the creator, so it can't rely on chck_tqueue_collect to free the slots
+      pthread_t thread;
+      assert(pthread_create(&thread, NULL, submitter, &fan) == 0);
+      pthread_join(thread, NULL);
+
+      for (size_t i = 0; i < fan.count; ++i) {
+         assert(fan.steps[i].value == 1);
+         chck_graph_node_release(&fan.steps[i].node);
+      }
+      free(fan.steps);
+      chck_graph_release(&graph);
+   }
+
+   /* TEST: long chain */
+   {
+      struct chck_graph graph;
+      assert(chck_graph(&graph, 2, 2));
+
+      const size_t count = 10000;
+      struct step *steps;
+      assert((steps = calloc(count, sizeof(struct step))));
+
+      for (size_t i = 0; i < count; ++i) {
+         chck_graph_node(&steps[i].node, &graph, run);
+
+         if (i > 0) {
+            steps[i].input[0] = &steps[i - 1]; steps[i].ninputs = 1;
+            assert(chck_graph_depend(&steps[i].node, &steps[i - 1].node));
+         }
+
+         chck_graph_submit(&steps[i].node);
+      }
+
+      chck_graph_wait(&steps[count - 1].node);
+      assert(steps[count - 1].value == count);
+
+      for (size_t i = 0; i < count; ++i)
+         chck_graph_node_release(&steps[i].node);
+      free(steps);
+      chck_graph_release(&graph);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+#include "parallel.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+// chunks for each participating thread, when grain is picked automatically
+#define CHUNKS_PER_THREAD 8
+
+// capacity of the worker deques
+#define CAPACITY 256
+
+struct job {
+   void (*function)();
+   void *ctx;
+
+   // next chunk to claim
+   size_t next;
+
+   size_t begin, end, grain, nchunks;
+   void *partials;
+   size_t stride;
+
+   struct chck_steal_group group;
+};
+
+struct helper {
+   struct chck_steal_task task;
+   struct job *job;
+   size_t index;
+};
+
+static void
+loop(struct job *job, size_t index)
+{
+   assert(job);
+
+   void *partial = (job->partials ? job->partials + index * job->stride : NULL);
+
+   size_t chunk;
+   while ((chunk = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks) {
+      // chunk * grain < end - begin, so this can't overflow
+      const size_t b = job->begin + chunk * job->grain;
+      const size_t e = (job->end - b > job->grain ? b + job->grain : job->end);
+
+      if (partial) {
+         job->function(b, e, job->ctx, partial);
+      } else {
+         job->function(b, e, job->ctx);
+      }
+   }
+}
+
+static void
+help(struct chck_steal_task *task)
+{
+   assert(task);
+   struct helper *helper = (struct helper*)task;
+   loop(helper->job, helper->index);
+}
+
+static bool
+run(struct chck_parallel *parallel, size_t begin, size_t end, size_t grain, void (*function)(), void *ctx, void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && function);
+
+   if (begin >= end)
+      return true;
+
+   const size_t count = end - begin;
+   const size_t participants = parallel->nthreads + 1;
+
+   if (!grain) {
+      const size_t chunks = participants * CHUNKS_PER_THREAD;
+      grain = count / chunks + (count % chunks != 0);
+   }
+
+   struct job job = {
+      .function = function,
+      .ctx = ctx,
+      .begin = begin,
+      .end = end,
+      .grain = grain,
+      .nchunks = count / grain + (count % grain != 0),
+      .stride = ((rsize + CHCK_CACHE_LINE - 1) / CHCK_CACHE_LINE) * CHCK_CACHE_LINE,
+   };
+
+   // one chunk, no need for helpers
+   const size_t nhelpers = (job.nchunks - 1 < parallel->nthreads ? job.nchunks - 1 : parallel->nthreads);
+
+   // helpers, then cache line aligned partials for each participant
+   size_t hsz, psz, sz;
+   if (unlikely(chck_mul_ofsz(nhelpers, sizeof(struct helper), &hsz)) ||
+       unlikely(chck_mul_ofsz(nhelpers + 1, job.stride, &psz)) ||
+       unlikely(chck_add_ofsz(hsz, psz, &sz)) ||
+       unlikely(chck_add_ofsz(sz, CHCK_CACHE_LINE, &sz)))
+      return false;
+
+   // scratch is in use by outer or concurrent call, don't touch it
+   void *scratch = NULL;
+   const bool own = __atomic_exchange_n(&parallel->busy, true, __ATOMIC_ACQUIRE);
+
+   if (own) {
+      if (!(scratch = malloc(sz)))
+         return false;
+   } else {
+      if (sz > parallel->scratch_size) {
+         void *tmp;
+         if (!(tmp = realloc(parallel->scratch, sz))) {
+            __atomic_store_n(&parallel->busy, false, __ATOMIC_RELEASE);
+            return false;
+         }
+
+         parallel->scratch = tmp;
+         parallel->scratch_size = sz;
+      }
+
+      scratch = parallel->scratch;
+   }
+
+   struct helper *helpers = scratch;
+
+   if (rsize > 0) {
+      job.partials = (void*)(((uintptr_t)(scratch + hsz) + CHCK_CACHE_LINE - 1) & ~(uintptr_t)(CHCK_CACHE_LINE - 1));
+      memset(job.partials, 0, psz);
+   }
+
+   for (size_t i = 0; i < nhelpers; ++i) {
+      helpers[i] = (struct helper){
+         .task = { .function = help },
+         .job = &job,
+         .index = i + 1,
+      };
+
+      chck_steal_spawn(&parallel->steal, &job.group, &helpers[i].task);
+   }
+
+   // this thread is participant 0
+   loop(&job, 0);
+   chck_steal_group_wait(&parallel->steal, &job.group);
+
+   if (rsize > 0 && reduce) {
+      for (size_t i = 0; i < nhelpers + 1; ++i)
+         reduce(result, job.partials + i * job.stride);
+   }
+
+   if (own) {
+      free(scratch);
+   } else {
+      __atomic_store_n(&parallel->busy, false, __ATOMIC_RELEASE);
+   }
+
+   return true;
+}
+
+bool
+chck_parallel_for(struct chck_parallel *parallel, size_t begin, size_t end, size_t grain, void (*function)(size_t begin, size_t end, void *ctx), void *ctx)
+{
+   assert(parallel && function);
+   return run(parallel, begin, end, grain, function, ctx, NULL, NULL, 0);
+}
+
+bool
+chck_parallel_reduce(struct chck_parallel *parallel, size_t begin, size_t end, size_t grain, void (*function)(size_t begin, size_t end, void *ctx, void *partial), void *ctx, void (*reduce)(void *result, const void *partial), void *result, size_t rsize)
+{
+   assert(parallel && function && reduce && result && rsize > 0);
+
+   if (unlikely(!rsize))
+      return false;
+
+   return run(parallel, begin, end, grain, function, ctx, reduce, result, rsize);
+}
+
+void
+chck_parallel_release(struct chck_parallel *parallel)
+{
+   if (!parallel)
+      return;
+
+   chck_steal_release(&parallel->steal);
+   free(parallel->scratch);
+   memset(parallel, 0, sizeof(struct chck_parallel));
+}
+
+bool
+chck_parallel(struct chck_parallel *parallel, size_t nthreads)
+{
+   assert(parallel && nthreads > 0);
+   memset(parallel, 0, sizeof(struct chck_parallel));
+
+   if (unlikely(!nthreads))
+      return false;
+
+   if (!chck_steal(&parallel->steal, nthreads, CAPACITY))
+      return false;
+
+   parallel->nthreads = nthreads;
+   return true;
+}
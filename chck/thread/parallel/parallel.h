@@ -0,0 +1,41 @@
+#ifndef __chck_parallel__
+#define __chck_parallel__
+
+#include <chck/macros.h>
+#include <chck/thread/steal/steal.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct chck_parallel {
+   struct chck_steal steal;
+
+   // reused storage for helper tasks and partial results of one call
+   void *scratch;
+   size_t scratch_size;
+   bool busy;
+
+   // number of worker threads
+   size_t nthreads;
+};
+
+/**
+ * Data parallel loops over index range [begin, end) on chck_steal worker threads (and the calling thread).
+ * The range is cut to chunks of grain indices, which the participating threads claim one by one from shared counter.
+ * Nothing is allocated per chunk, only one task per worker is spawned for each call.
+ * grain 0 picks the grain automatically, so there are few chunks for each thread to balance the load.
+ *
+ * chck_parallel_for calls function(begin, end, ctx) for each chunk.
+ * chck_parallel_reduce calls function(begin, end, ctx, partial), where partial is zero initialized storage of rsize bytes, owned by the thread that runs the chunk.
+ * Once every chunk is done, reduce(result, partial) is called on the calling thread for each partial.
+ * Which chunks end up in which partial is not deterministic, so reduce must be associative and commutative.
+ *
+ * The calls return when the whole range has been processed, and may be nested (called from inside function).
+ * The storage is reused between calls, nested or concurrent calls allocate their own.
+ */
+
+CHCK_NONULL bool chck_parallel(struct chck_parallel *parallel, size_t nthreads);
+void chck_parallel_release(struct chck_parallel *parallel);
+CHCK_NONULLV(1, 5) bool chck_parallel_for(struct chck_parallel *parallel, size_t begin, size_t end, size_t grain, void (*function)(size_t begin, size_t end, void *ctx), void *ctx);
+CHCK_NONULLV(1, 5, 7, 8) bool chck_parallel_reduce(struct chck_parallel *parallel, size_t begin, size_t end, size_t grain, void (*function)(size_t begin, size_t end, void *ctx, void *partial), void *ctx, void (*reduce)(void *result, const void *partial), void *result, size_t rsize);
+
+#endif /* __chck_parallel__ */
@@ -0,0 +1,109 @@
+#include "parallel.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+struct ctx {
+   struct chck_parallel *parallel;
+   uint32_t *values;
+};
+
+static void
+square(size_t begin, size_t end, void *ctx)
+{
+   uint32_t *values = ((struct ctx*)ctx)->values;
+   for (size_t i = begin; i < end; ++i)
+      values[i] = i * i;
+}
+
+static void
+sum(size_t begin, size_t end, void *ctx, void *partial)
+{
+   const uint32_t *values = ((struct ctx*)ctx)->values;
+   for (size_t i = begin; i < end; ++i)
+      *(uint64_t*)partial += values[i];
+}
+
+static void
+add(void *result, const void *partial)
+{
+   *(uint64_t*)result += *(const uint64_t*)partial;
+}
+
+static void
+length(size_t begin, size_t end, void *ctx)
+{
+   assert(begin < end);
+   __atomic_add_fetch((size_t*)ctx, end - begin, __ATOMIC_RELAXED);
+}
+
+static void
+nested(size_t begin, size_t end, void *ctx)
+{
+   struct ctx *c = ctx;
+   for (size_t i = begin; i < end; ++i) {
+      struct ctx inner = { c->parallel, c->values + i * 100 };
+      assert(chck_parallel_for(c->parallel, 0, 100, 7, square, &inner));
+   }
+}
+
+int main(void)
+{
+   struct chck_parallel parallel;
+   assert(chck_parallel(&parallel, 3));
+
+   /* TEST: for and reduce */
+   {
+      const size_t count = 100000;
+      uint32_t *values;
+      assert((values = calloc(count, sizeof(uint32_t))));
+      struct ctx ctx = { &parallel, values };
+
+      for (size_t grain = 0; grain < 4000; grain = grain * 3 + 1) {
+         assert(chck_parallel_for(&parallel, 0, count, grain, square, &ctx));
+
+         for (size_t i = 0; i < count; ++i) {
+            assert(values[i] == (uint32_t)(i * i));
+            values[i] = 1;
+         }
+
+         uint64_t result = 0;
+         assert(chck_parallel_reduce(&parallel, 10, count, grain, sum, &ctx, add, &result, sizeof(result)));
+         assert(result == count - 10);
+      }
+
+      // empty, single chunk and huge grain
+      uint64_t result = 0;
+      assert(chck_parallel_reduce(&parallel, 5, 5, 0, sum, &ctx, add, &result, sizeof(result)));
+      assert(result == 0);
+      assert(chck_parallel_reduce(&parallel, 0, 1, 0, sum, &ctx, add, &result, sizeof(result)));
+      assert(result == 1);
+      assert(chck_parallel_reduce(&parallel, 0, count, SIZE_MAX, sum, &ctx, add, &result, sizeof(result)));
+      assert(result == count + 1);
+
+      // range at the end of size_t
+      size_t total = 0;
+      assert(chck_parallel_for(&parallel, SIZE_MAX - 10, SIZE_MAX, 3, length, &total));
+      assert(total == 10);
+      free(values);
+   }
+
+   /* TEST: nested */
+   {
+      uint32_t *values;
+      assert((values = calloc(100 * 100, sizeof(uint32_t))));
+      struct ctx ctx = { &parallel, values };
+
+      assert(chck_parallel_for(&parallel, 0, 100, 1, nested, &ctx));
+
+      for (size_t i = 0; i < 100 * 100; ++i)
+         assert(values[i] == (uint32_t)((i % 100) * (i % 100)));
+
+      free(values);
+   }
+
+   chck_parallel_release(&parallel);
+   return EXIT_SUCCESS;
+}
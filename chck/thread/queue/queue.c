@@ -1,3 +1,7 @@
+#ifdef __linux__
+#  define _GNU_SOURCE
+#endif
+
 #include "queue.h"
 #include <chck/overflow/overflow.h>
 #include <unistd.h>
@@ -5,6 +9,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
 #include <assert.h>
 
 #if HAS_VALGRIND
@@ -14,6 +21,8 @@
 #  define VALGRIND_HG_ENABLE_CHECKING(x, y) ;
 #endif
 
+static size_t collect_completed(struct chck_tasks *tasks);
+
 static bool
 creator_thread(const struct chck_tqueue *tqueue, const char *function)
 {
@@ -26,290 +35,1862 @@ creator_thread(const struct chck_tqueue *tqueue, const char *function)
 }
 #define creator_thread(x) creator_thread(x, __FUNCTION__)
 
+#ifdef __linux__
+// upper limit of cpus and nodes we care about
+#  define MAX_CPUS 4096
+#  define MAX_NODES 256
+
+static size_t
+read_list(const char *path, size_t *out, size_t max)
+{
+   assert(path && out);
+
+   // sysfs lists are of form "0-3,8,10-11"
+   FILE *f;
+   if (!(f = fopen(path, "r")))
+      return 0;
+
+   size_t count = 0;
+   unsigned long a, b;
+   while (count < max && fscanf(f, "%lu", &a) == 1) {
+      b = a;
+
+      int c;
+      if ((c = fgetc(f)) == '-') {
+         if (fscanf(f, "%lu", &b) != 1)
+            break;
+
+         c = fgetc(f);
+      }
+
+      for (; a <= b && count < max; ++a)
+         out[count++] = a;
+
+      if (c != ',')
+         break;
+   }
+
+   fclose(f);
+   return count;
+}
+
+static size_t
+read_node_cpus(size_t node, size_t *out, size_t max)
+{
+   char path[128];
+   snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+   return read_list(path, out, max);
+}
+
+static bool
+set_affinity(struct chck_tqueue_worker *worker, const size_t *cpus, size_t ncpus)
+{
+   assert(worker);
+
+   if (worker->affinity)
+      CPU_FREE(worker->affinity);
+
+   worker->affinity = NULL;
+   worker->affinity_size = 0;
+
+   if (!ncpus)
+      return true;
+
+   size_t max = 0;
+   for (size_t i = 0; i < ncpus; ++i)
+      max = (cpus[i] > max ? cpus[i] : max);
+
+   cpu_set_t *set;
+   if (!(set = CPU_ALLOC(max + 1)))
+      return false;
+
+   const size_t size = CPU_ALLOC_SIZE(max + 1);
+   CPU_ZERO_S(size, set);
+
+   for (size_t i = 0; i < ncpus; ++i)
+      CPU_SET_S(cpus[i], size, set);
+
+   worker->affinity = set;
+   worker->affinity_size = size;
+   return true;
+}
+#endif
+
+static uint64_t
+now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void
+stat_add(uint64_t *stat, uint64_t value)
+{
+   // only one thread writes each of these, others only read
+   __atomic_store_n(stat, *stat + value, __ATOMIC_RELAXED);
+}
+
 static void*
-get_data(struct chck_tasks *tasks, size_t index)
+get_data(struct chck_tasks *tasks, struct chck_tqueue_lane *lane, size_t index)
 {
-   assert(tasks && tasks->buffer);
+   assert(tasks && lane && lane->buffer);
 
    if (index >= tasks->qsize)
       return NULL;
 
-   return tasks->buffer + (index * tasks->msize);
+   return lane->buffer + (index * tasks->msize);
 }
 
-static void*
-on_thread(void *arg)
+static size_t
+enqueue(struct chck_tasks *tasks, struct chck_tqueue_lane *lane, const void *data, size_t n, size_t *out_pos)
 {
-   assert(arg);
-   struct chck_tasks *tasks = arg;
+   assert(tasks && lane && n > 0 && out_pos);
 
+   // Slot is free for position when its sequence equals the position.
+   size_t pos = __atomic_load_n(&lane->tail, __ATOMIC_RELAXED), count;
    while (true) {
-      // XXX: We could use seperate lock here for dequeueing, and have own lock for insertion.
-      pthread_mutex_lock(&tasks->mutex);
+      const size_t seq = __atomic_load_n(&lane->sequence[pos % tasks->qsize], __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+      if (diff == 0) {
+         // slots are freed in order, so claim the following free slots with the same exchange
+         for (count = 1; count < n && count < tasks->qsize; ++count) {
+            if (__atomic_load_n(&lane->sequence[(pos + count) % tasks->qsize], __ATOMIC_ACQUIRE) != pos + count)
+               break;
+         }
 
-      if (!tasks->cancel && !tasks->tcount)
-         pthread_cond_wait(&tasks->notify, &tasks->mutex);
+         if (__atomic_compare_exchange_n(&lane->tail, &pos, pos + count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if (diff < 0) {
+         // slot is still occupied from the previous lap, queue is full
+         return 0;
+      } else {
+         pos = __atomic_load_n(&lane->tail, __ATOMIC_RELAXED);
+      }
+   }
 
-      if (tasks->cancel)
-         break;
+   *out_pos = pos;
 
-      if (!tasks->tcount) {
-         pthread_mutex_unlock(&tasks->mutex);
-         continue;
-      }
+   // without data, the slots are only reserved and chck_tqueue_commit publishes them
+   if (!data)
+      return count;
 
-      assert(tasks->tcount > 0);
-      bool *processed = &tasks->processed[tasks->thead];
-      void *data = get_data(tasks, tasks->thead);
-      void (*work)() = tasks->work;
-      tasks->thead = (tasks->thead + 1) % tasks->qsize;
-      tasks->tcount -= 1;
+   if (lane->stamps) {
+      const uint64_t now = now_ns();
+      for (size_t i = 0; i < count; ++i)
+         lane->stamps[(pos + i) % tasks->qsize] = now;
+   }
 
-      pthread_mutex_unlock(&tasks->mutex);
+   for (size_t i = 0; i < count; ++i) {
+      const size_t slot = (pos + i) % tasks->qsize;
+      memcpy(get_data(tasks, lane, slot), data + i * tasks->msize, tasks->msize);
 
-      // We only may read race against these. That's okay.
-      // The user should not meddle with the input outside of the callbacks.
-      // And tqueue won't touch the item when worker is working on it.
-      VALGRIND_HG_DISABLE_CHECKING(data, tasks->msize);
+      // publish for workers
+      __atomic_store_n(&lane->sequence[slot], pos + i + 1, __ATOMIC_RELEASE);
+   }
 
-      work(data);
-      *processed = true;
+   __atomic_add_fetch(&lane->nadded, count, __ATOMIC_RELAXED);
+   return count;
+}
 
-      VALGRIND_HG_ENABLE_CHECKING(data, tasks->msize);
+static size_t
+dequeue(struct chck_tasks *tasks, struct chck_tqueue_lane *lane, size_t max, size_t *out_pos)
+{
+   assert(tasks && lane && max > 0 && out_pos);
+
+   // Slot is ready to be worked on when its sequence is position + 1.
+   size_t pos = __atomic_load_n(&lane->thead, __ATOMIC_RELAXED), count;
+   while (true) {
+      const size_t seq = __atomic_load_n(&lane->sequence[pos % tasks->qsize], __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+      if (diff == 0) {
+         // producers publish out of order, claim only the unbroken run of published slots
+         for (count = 1; count < max; ++count) {
+            if (__atomic_load_n(&lane->sequence[(pos + count) % tasks->qsize], __ATOMIC_ACQUIRE) != pos + count + 1)
+               break;
+         }
 
-      if (tasks->fd >= 0)
-         write(tasks->fd, (uint64_t[]){1}, sizeof(uint64_t));
+         if (__atomic_compare_exchange_n(&lane->thead, &pos, pos + count, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if (diff < 0) {
+         // nothing published yet
+         return 0;
+      } else {
+         pos = __atomic_load_n(&lane->thead, __ATOMIC_RELAXED);
+      }
    }
 
-   pthread_mutex_unlock(&tasks->mutex);
-   return NULL;
+   *out_pos = pos;
+   return count;
 }
 
-static void
-stop(struct chck_tqueue *tqueue)
+static size_t
+dequeue_any(struct chck_tqueue_worker *worker, size_t *out_lane, size_t *out_pos)
 {
-   assert(tqueue);
+   assert(worker && out_lane && out_pos);
+   struct chck_tasks *tasks = worker->tasks;
 
-   if (!tqueue->threads.running)
-      return;
+   // every starve'th claim starts from the lowest priority lane, so they get through even when higher lanes are busy
+   const bool reverse = (tasks->starve > 0 && (worker->claims + 1) % tasks->starve == 0);
 
-   pthread_mutex_lock(&tqueue->tasks.mutex);
-   tqueue->tasks.cancel = true;
-   pthread_cond_broadcast(&tqueue->tasks.notify);
-   pthread_mutex_unlock(&tqueue->tasks.mutex);
+   for (size_t i = 0; i < tasks->nlanes; ++i) {
+      const size_t l = (reverse ? tasks->nlanes - 1 - i : i);
 
-   for (size_t i = 0; i < tqueue->threads.count; ++i)
-      pthread_join(tqueue->threads.t[i], NULL);
+      size_t count;
+      if ((count = dequeue(tasks, &tasks->lanes[l], tasks->batch, out_pos))) {
+         ++worker->claims;
+         *out_lane = l;
+         return count;
+      }
+   }
 
-   memset(tqueue->threads.t, 0, sizeof(pthread_t) * tqueue->threads.count);
-   tqueue->threads.running = false;
+   return 0;
 }
 
-static bool
-start(struct chck_tqueue *tqueue)
+static void
+done_push(struct chck_tasks *tasks, size_t lane, size_t position)
 {
-   assert(tqueue);
+   assert(tasks && tasks->done.enabled);
 
-   if (tqueue->threads.running)
-      return true;
+   // At most qsize tasks per lane are in flight, so there is always room.
+   size_t pos = __atomic_load_n(&tasks->done.tail, __ATOMIC_RELAXED);
+   while (true) {
+      const size_t seq = __atomic_load_n(&tasks->done.sequence[pos % tasks->done.size], __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+      if (diff == 0) {
+         if (__atomic_compare_exchange_n(&tasks->done.tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else {
+         // diff < 0 can only be a slot that is being popped right now
+         pos = __atomic_load_n(&tasks->done.tail, __ATOMIC_RELAXED);
+      }
+   }
 
-   tqueue->tasks.cancel = false;
+   const size_t slot = pos % tasks->done.size;
+   tasks->done.lanes[slot] = lane;
+   tasks->done.positions[slot] = position;
+   __atomic_store_n(&tasks->done.sequence[slot], pos + 1, __ATOMIC_RELEASE);
+}
 
-   for (size_t i = 0; i < tqueue->threads.count; ++i) {
-      if (pthread_create(&tqueue->threads.t[i], NULL, on_thread, &tqueue->tasks) != 0)
+static bool
+done_pop(struct chck_tasks *tasks, size_t *out_lane, size_t *out_position)
+{
+   assert(tasks && tasks->done.enabled && out_lane && out_position);
+
+   size_t pos = __atomic_load_n(&tasks->done.head, __ATOMIC_RELAXED);
+   while (true) {
+      const size_t seq = __atomic_load_n(&tasks->done.sequence[pos % tasks->done.size], __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+      if (diff == 0) {
+         if (__atomic_compare_exchange_n(&tasks->done.head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      } else if (diff < 0) {
          return false;
+      } else {
+         pos = __atomic_load_n(&tasks->done.head, __ATOMIC_RELAXED);
+      }
    }
 
-   tqueue->threads.running = true;
+   const size_t slot = pos % tasks->done.size;
+   *out_lane = tasks->done.lanes[slot];
+   *out_position = tasks->done.positions[slot];
+   __atomic_store_n(&tasks->done.sequence[slot], pos + tasks->done.size, __ATOMIC_RELEASE);
    return true;
 }
 
-bool
-chck_tqueue_add_task(struct chck_tqueue *tqueue, void *data, useconds_t block)
+static void
+done_release(struct chck_tasks *tasks)
 {
-   assert(tqueue && data);
+   assert(tasks);
+
+   if (tasks->done.enabled)
+      pthread_mutex_destroy(&tasks->done.mutex);
+
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      free(tasks->lanes[l].collected);
+      tasks->lanes[l].collected = NULL;
+   }
+
+   free(tasks->done.lanes);
+   free(tasks->done.positions);
+   free(tasks->done.sequence);
+   memset(&tasks->done, 0, sizeof(tasks->done));
+}
+
+static bool
+done(struct chck_tasks *tasks)
+{
+   assert(tasks && !tasks->done.enabled);
 
-   if (!tqueue->threads.running && !start(tqueue))
+   if (unlikely(chck_mul_ofsz(tasks->qsize, tasks->nlanes, &tasks->done.size)))
       return false;
 
-   const size_t next = (tqueue->tasks.tail + 1) % tqueue->tasks.qsize;
-   assert(next < tqueue->tasks.qsize);
+   if (!(tasks->done.lanes = chck_calloc_of(tasks->done.size, sizeof(size_t))) ||
+       !(tasks->done.positions = chck_calloc_of(tasks->done.size, sizeof(size_t))) ||
+       !(tasks->done.sequence = chck_calloc_of(tasks->done.size, sizeof(size_t))))
+      goto fail;
 
-   bool ret = false;
-   while (true) {
-      pthread_mutex_lock(&tqueue->tasks.mutex);
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      if (!(tasks->lanes[l].collected = chck_calloc_of(tasks->qsize, sizeof(bool))))
+         goto fail;
+   }
+
+   if (pthread_mutex_init(&tasks->done.mutex, NULL) != 0)
+      goto fail;
 
-      if (tqueue->tasks.count >= tqueue->tasks.qsize) {
-         if (block) {
-            pthread_mutex_unlock(&tqueue->tasks.mutex);
+   for (size_t i = 0; i < tasks->done.size; ++i)
+      tasks->done.sequence[i] = i;
 
-            if (tqueue->threads.self == pthread_self())
-               chck_tqueue_collect(tqueue);
+   tasks->done.enabled = true;
+   return true;
 
-            usleep(block);
-            continue;
-         }
-         break;
-      }
+fail:
+   done_release(tasks);
+   return false;
+}
 
-      if (tqueue->tasks.cancel)
-         break;
+static bool
+has_work(struct chck_tasks *tasks)
+{
+   assert(tasks);
 
-      void *ptr = get_data(&tqueue->tasks, tqueue->tasks.tail);
-      memcpy(ptr, data, tqueue->tasks.msize);
-      tqueue->tasks.processed[tqueue->tasks.tail] = false;
-      tqueue->tasks.tail = next;
-      tqueue->tasks.count += 1;
-      tqueue->tasks.tcount += 1;
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      struct chck_tqueue_lane *lane = &tasks->lanes[l];
+      const size_t pos = __atomic_load_n(&lane->thead, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&lane->sequence[pos % tasks->qsize], __ATOMIC_SEQ_CST) == pos + 1)
+         return true;
 
-      pthread_cond_signal(&tqueue->tasks.notify);
-      ret = true;
-      break;
+      if (__atomic_load_n(&lane->overflow.pending, __ATOMIC_SEQ_CST))
+         return true;
    }
 
-   pthread_mutex_unlock(&tqueue->tasks.mutex);
-   return ret;
+   return false;
 }
 
-size_t
-chck_tqueue_collect(struct chck_tqueue *tqueue)
+static void
+lane_release(struct chck_tasks *tasks, struct chck_tqueue_lane *lane)
 {
-   assert(tqueue);
+   assert(tasks && lane);
 
-   // For simplicity, we only allow collection on creator thread.
-   // Collecting anywhere else does not make sense anyways.
-   if (!tqueue || !creator_thread(tqueue))
-      return 0;
+   if (tasks->destructor && lane->buffer) {
+      for (size_t i = lane->head; i != lane->tail; ++i)
+         tasks->destructor(get_data(tasks, lane, i % tasks->qsize));
+   }
 
-   if (tqueue->tasks.fd >= 0) {
-      char buf[sizeof(uint64_t)];
-      read(tqueue->tasks.fd, buf, sizeof(buf));
+   struct chck_tqueue_chunk *chunk = lane->overflow.first;
+   for (size_t i = lane->overflow.head; chunk && i != lane->overflow.tail;) {
+      if (tasks->destructor)
+         tasks->destructor(chunk->items + (i % tasks->qsize) * tasks->msize);
+
+      if (++i % tasks->qsize == 0)
+         chunk = chunk->next;
    }
 
-   pthread_mutex_lock(&tqueue->tasks.mutex);
-   const size_t head = tqueue->tasks.head;
-   const size_t count = tqueue->tasks.count;
-   pthread_mutex_unlock(&tqueue->tasks.mutex);
+   for (struct chck_tqueue_chunk *next; lane->overflow.first; lane->overflow.first = next) {
+      next = lane->overflow.first->next;
+      free(lane->overflow.first);
+   }
 
-   // Read races again fine here.
-   // We can't enter inside until the thread is done with the item.
-   size_t processed = 0;
-   for (size_t i = head, x = 0; x < count; i = (i + 1) % tqueue->tasks.qsize, ++x) {
-      if (!tqueue->tasks.processed[i])
-         continue;
+   free(lane->overflow.spare);
+   pthread_mutex_destroy(&lane->overflow.mutex);
 
-      void *data = get_data(&tqueue->tasks, i);
-      VALGRIND_HG_DISABLE_CHECKING(data, tqueue->tasks.msize);
+   free(lane->stamps);
+   free(lane->collected);
+   free(lane->sequence);
+   free(lane->processed);
+   free(lane->buffer);
+   memset(lane, 0, sizeof(struct chck_tqueue_lane));
+}
 
-      if (tqueue->tasks.callback)
-         tqueue->tasks.callback(data);
+static bool
+lane(struct chck_tasks *tasks, struct chck_tqueue_lane *lane)
+{
+   assert(tasks && lane);
+   memset(lane, 0, sizeof(struct chck_tqueue_lane));
+   pthread_mutex_init(&lane->overflow.mutex, NULL);
 
-      if (tqueue->tasks.destructor)
-         tqueue->tasks.destructor(data);
+   if (!(lane->buffer = chck_calloc_of(tasks->qsize, tasks->msize)) ||
+       !(lane->processed = chck_calloc_of(tasks->qsize, sizeof(bool))) ||
+       !(lane->sequence = chck_calloc_of(tasks->qsize, sizeof(size_t))))
+      goto fail;
 
-      memset(data, 0, tqueue->tasks.msize);
-      VALGRIND_HG_ENABLE_CHECKING(data, tqueue->tasks.msize);
+   if (tasks->done.enabled && !(lane->collected = chck_calloc_of(tasks->qsize, sizeof(bool))))
+      goto fail;
 
-      tqueue->tasks.processed[i] = false;
-      ++processed;
-   }
+   if (tasks->stats.enabled && !(lane->stamps = chck_calloc_of(tasks->qsize, sizeof(uint64_t))))
+      goto fail;
 
-   // We need to lock here however
-   pthread_mutex_lock(&tqueue->tasks.mutex);
-   assert(tqueue->tasks.count >= processed);
-   tqueue->tasks.head = (tqueue->tasks.head + processed) % tqueue->tasks.qsize;
-   tqueue->tasks.count -= processed;
-   const size_t rcount = tqueue->tasks.count;
-   pthread_mutex_unlock(&tqueue->tasks.mutex);
+   for (size_t i = 0; i < tasks->qsize; ++i)
+      lane->sequence[i] = i;
 
-   if (!rcount)
-      stop(tqueue);
+   // We allow racy reads on this array.
+   // However we don't allow racy writes.
+   // Unfortunately some helgrind macros are unimplemented that would allow turning this off just for reads.
+   VALGRIND_HG_DISABLE_CHECKING(lane->processed, tasks->qsize);
+   return true;
 
-   return rcount;
+fail:
+   lane_release(tasks, lane);
+   return false;
 }
 
-void
-chck_tqueue_release(struct chck_tqueue *tqueue)
+static void
+lanes_release(struct chck_tasks *tasks)
 {
-   // Allowed only on creator thread.
-   if (!tqueue || (tqueue->threads.self && !creator_thread(tqueue)))
-      return;
+   assert(tasks);
 
-   stop(tqueue);
-   pthread_mutex_destroy(&tqueue->tasks.mutex);
-   pthread_cond_destroy(&tqueue->tasks.notify);
+   for (size_t l = 0; l < tasks->nlanes; ++l)
+      lane_release(tasks, &tasks->lanes[l]);
 
-   if (tqueue->tasks.destructor) {
-      for (size_t i = tqueue->tasks.head, x = 0; x < tqueue->tasks.count; i = (i + 1) % tqueue->tasks.qsize, ++x)
-         tqueue->tasks.destructor(get_data(&tqueue->tasks, i));
-   }
+   free(tasks->lanes);
+   tasks->lanes = NULL;
+   tasks->nlanes = 0;
+}
 
-   if (tqueue->tasks.fd >= 0)
-      close(tqueue->tasks.fd);
+static bool
+lanes(struct chck_tasks *tasks, size_t nlanes)
+{
+   assert(tasks && !tasks->lanes && nlanes > 0);
 
-   free(tqueue->tasks.processed);
-   free(tqueue->tasks.buffer);
-   free(tqueue->threads.t);
-   memset(tqueue, 0, sizeof(struct chck_tqueue));
+   if (!(tasks->lanes = chck_calloc_of(nlanes, sizeof(struct chck_tqueue_lane))))
+      return false;
+
+   // new lanes count from zero
+   tasks->stats.added = tasks->stats.collected = 0;
+
+   for (; tasks->nlanes < nlanes; ++tasks->nlanes) {
+      if (!lane(tasks, &tasks->lanes[tasks->nlanes])) {
+         lanes_release(tasks);
+         return false;
+      }
+   }
+
+   return true;
 }
 
-void
-chck_tqueue_set_fd(struct chck_tqueue *tqueue, int fd)
+static struct chck_tqueue_chunk*
+chunk(struct chck_tasks *tasks)
 {
-   assert(tqueue);
+   assert(tasks);
 
-   // Allowed only on creator thread.
-   if (!tqueue || !creator_thread(tqueue))
-      return;
+   // header, states and tasks in one allocation, tasks aligned to 16 bytes
+   const size_t offset = (sizeof(struct chck_tqueue_chunk) + tasks->qsize + 15) & ~(size_t)15;
 
-   if (tqueue->tasks.fd >= 0)
-      close(tqueue->tasks.fd);
+   size_t sz;
+   if (unlikely(chck_mul_ofsz(tasks->qsize, tasks->msize, &sz)) || unlikely(chck_add_ofsz(sz, offset, &sz)))
+      return NULL;
 
-   tqueue->tasks.fd = dup(fd);
+   struct chck_tqueue_chunk *chunk;
+   if (!(chunk = calloc(1, sz)))
+      return NULL;
+
+   chunk->state = (void*)(chunk + 1);
+   chunk->items = (void*)chunk + offset;
+   return chunk;
 }
 
-int
-chck_tqueue_get_fd(struct chck_tqueue *tqueue)
+static size_t
+overflow_push(struct chck_tasks *tasks, struct chck_tqueue_lane *lane, const void *data, size_t n)
 {
-   assert(tqueue);
+   assert(tasks && lane && data);
 
-   // Allowed only on creator thread.
-   if (!tqueue || !creator_thread(tqueue))
-      return -1;
+   pthread_mutex_lock(&lane->overflow.mutex);
 
-   return tqueue->tasks.fd;
+   size_t count = 0;
+   for (; count < n; ++count) {
+      if (tasks->limit && lane->overflow.tail - lane->overflow.head >= tasks->limit)
+         break;
+
+      const size_t index = lane->overflow.tail % tasks->qsize;
+
+      // tail is at the end of last chunk (or there is none), chain new one
+      // chunks are never chained empty, so tail at start of chunk means the last chunk is full
+      if (!lane->overflow.last || !index) {
+         struct chck_tqueue_chunk *c;
+         if ((c = lane->overflow.spare)) {
+            lane->overflow.spare = NULL;
+            c->next = NULL;
+         } else if (!(c = chunk(tasks))) {
+            break;
+         }
+
+         if (lane->overflow.last) {
+            lane->overflow.last->next = c;
+         } else {
+            lane->overflow.first = c;
+         }
+
+         lane->overflow.last = c;
+
+         if (!lane->overflow.work)
+            lane->overflow.work = c;
+      }
+
+      memcpy(lane->overflow.last->items + index * tasks->msize, data + count * tasks->msize, tasks->msize);
+      ++lane->overflow.tail;
+   }
+
+   __atomic_store_n(&lane->overflow.count, lane->overflow.tail - lane->overflow.head, __ATOMIC_RELEASE);
+   __atomic_store_n(&lane->overflow.pending, lane->overflow.tail - lane->overflow.thead, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&lane->overflow.mutex);
+
+   __atomic_add_fetch(&lane->nadded, count, __ATOMIC_RELAXED);
+   return count;
 }
 
-bool
-chck_tqueue(struct chck_tqueue *tqueue, size_t nthreads, size_t qsize, size_t msize, void (*work)(), void (*callback)(), void (*destructor)())
+static bool
+overflow_claim(struct chck_tasks *tasks, struct chck_tqueue_lane *lane, struct chck_tqueue_chunk **out_chunk, size_t *out_index)
 {
-   assert(tqueue && work && msize > 0);
-   memset(tqueue, 0, sizeof(struct chck_tqueue));
-   tqueue->tasks.fd = -1;
+   assert(tasks && lane && out_chunk && out_index);
 
-   if (!msize || !work)
+   if (!__atomic_load_n(&lane->overflow.pending, __ATOMIC_ACQUIRE))
       return false;
 
-   if (!(tqueue->tasks.buffer = chck_calloc_of(qsize, msize)) ||
-       !(tqueue->tasks.processed = chck_calloc_of(qsize, sizeof(bool))))
+   pthread_mutex_lock(&lane->overflow.mutex);
+
+   if (lane->overflow.thead == lane->overflow.tail) {
+      pthread_mutex_unlock(&lane->overflow.mutex);
       return false;
+   }
 
-   // We allow racy reads on this array.
-   // However we don't allow racy writes.
-   // Unfortunately some helgrind macros are unimplemented that would allow turning this off just for reads.
-   VALGRIND_HG_DISABLE_CHECKING(tqueue->tasks.processed, qsize);
+   *out_chunk = lane->overflow.work;
+   *out_index = lane->overflow.thead % tasks->qsize;
+   __atomic_store_n(&(*out_chunk)->state[*out_index], 1, __ATOMIC_RELAXED);
 
-   if (pthread_mutex_init(&tqueue->tasks.mutex, NULL) != 0 ||
-       pthread_cond_init(&tqueue->tasks.notify, NULL) != 0)
-      goto fail;
+   if (++lane->overflow.thead % tasks->qsize == 0)
+      lane->overflow.work = lane->overflow.work->next;
 
-   if (!(tqueue->threads.t = chck_calloc_of(nthreads, sizeof(pthread_t))))
-      goto fail;
+   __atomic_store_n(&lane->overflow.pending, lane->overflow.tail - lane->overflow.thead, __ATOMIC_RELEASE);
+   pthread_mutex_unlock(&lane->overflow.mutex);
+   return true;
+}
 
-   tqueue->threads.self = pthread_self();
-   tqueue->threads.count = nthreads;
-   tqueue->tasks.msize = msize;
-   tqueue->tasks.qsize = qsize;
+static void
+shrink(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   // nothing spilled anymore, give the chunks back
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      struct chck_tqueue_lane *lane = &tasks->lanes[l];
+
+      // other producers may be spilling, so the chunks can only be looked at under the lock
+      pthread_mutex_lock(&lane->overflow.mutex);
+
+      if (lane->overflow.head == lane->overflow.tail) {
+         // with empty overflow, there's only the chunk with the head
+         free(lane->overflow.first);
+         free(lane->overflow.spare);
+         lane->overflow.first = lane->overflow.work = lane->overflow.last = lane->overflow.spare = NULL;
+         lane->overflow.head = lane->overflow.thead = lane->overflow.tail = 0;
+      }
+
+      pthread_mutex_unlock(&lane->overflow.mutex);
+   }
+}
+
+static size_t
+uncollected(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   size_t rcount = 0;
+   for (size_t l = 0; l < tasks->nlanes; ++l)
+      rcount += __atomic_load_n(&tasks->lanes[l].tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&tasks->lanes[l].head, __ATOMIC_ACQUIRE) + __atomic_load_n(&tasks->lanes[l].overflow.count, __ATOMIC_ACQUIRE);
+
+   return rcount;
+}
+
+static void
+wake_worker(struct chck_tasks *tasks, size_t count)
+{
+   assert(tasks);
+
+   // Pairs with the fence in on_thread, either we see the sleeper, or the sleeper sees the task.
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   if (!__atomic_load_n(&tasks->sleepers, __ATOMIC_RELAXED))
+      return;
+
+   // wake one parked worker for each task, the rest keep sleeping
+   pthread_mutex_lock(&tasks->mutex);
+   for (size_t n = tasks->sleepers; count > 0 && n > 0; --count) {
+      struct chck_tqueue_worker *worker = &tasks->workers[tasks->parked[--n]];
+      worker->woken = true;
+      pthread_cond_signal(&worker->cond);
+      __atomic_store_n(&tasks->sleepers, n, __ATOMIC_RELAXED);
+   }
+   pthread_mutex_unlock(&tasks->mutex);
+}
+
+static void
+signal_fd(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   if (tasks->fd < 0)
+      return;
+
+   // coalesce, the fd stays readable until collect drains it anyways
+   if (!__atomic_exchange_n(&tasks->signaled, true, __ATOMIC_ACQ_REL))
+      write(tasks->fd, (uint64_t[]){1}, sizeof(uint64_t));
+}
+
+static void
+drain_fd(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   if (tasks->fd < 0)
+      return;
+
+   // clear first, so tasks that finish after this signal again
+   if (__atomic_exchange_n(&tasks->signaled, false, __ATOMIC_SEQ_CST)) {
+      char buf[sizeof(uint64_t)];
+      read(tasks->fd, buf, sizeof(buf));
+   }
+}
+
+static void
+park(struct chck_tqueue_worker *worker)
+{
+   assert(worker);
+   struct chck_tasks *tasks = worker->tasks;
+
+   pthread_mutex_lock(&tasks->mutex);
+   const size_t index = worker - tasks->workers;
+   worker->woken = false;
+   tasks->parked[tasks->sleepers] = index;
+   __atomic_store_n(&tasks->sleepers, tasks->sleepers + 1, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   while (!worker->woken && !__atomic_load_n(&tasks->cancel, __ATOMIC_ACQUIRE) && !has_work(tasks))
+      pthread_cond_wait(&worker->cond, &tasks->mutex);
+
+   // left by ourself, remove from the parked stack
+   if (!worker->woken) {
+      for (size_t i = 0; i < tasks->sleepers; ++i) {
+         if (tasks->parked[i] != index)
+            continue;
+
+         tasks->parked[i] = tasks->parked[tasks->sleepers - 1];
+         __atomic_store_n(&tasks->sleepers, tasks->sleepers - 1, __ATOMIC_RELAXED);
+         break;
+      }
+   }
+
+   pthread_mutex_unlock(&tasks->mutex);
+}
+
+static void
+wake_producers(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   // Pairs with the fence in add_task, either we see the waiter, or the waiter sees the free slot.
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   if (!__atomic_load_n(&tasks->waiters, __ATOMIC_RELAXED))
+      return;
+
+   pthread_mutex_lock(&tasks->mutex);
+   pthread_cond_broadcast(&tasks->not_full);
+   pthread_mutex_unlock(&tasks->mutex);
+}
+
+static bool
+work_overflow(struct chck_tqueue_worker *worker)
+{
+   assert(worker);
+   struct chck_tasks *tasks = worker->tasks;
+
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      struct chck_tqueue_chunk *chunk;
+      size_t index;
+      if (!overflow_claim(tasks, &tasks->lanes[l], &chunk, &index))
+         continue;
+
+      const uint64_t start = (tasks->stats.enabled ? now_ns() : 0);
+
+      void *data = chunk->items + index * tasks->msize;
+      VALGRIND_HG_DISABLE_CHECKING(data, tasks->msize);
+      tasks->work(data);
+      VALGRIND_HG_ENABLE_CHECKING(data, tasks->msize);
+
+      if (tasks->stats.enabled) {
+         stat_add(&worker->stats.work_ns, now_ns() - start);
+         stat_add(&worker->stats.tasks, 1);
+      }
+
+      __atomic_store_n(&chunk->state[index], 2, __ATOMIC_RELEASE);
+      wake_producers(tasks);
+      signal_fd(tasks);
+      return true;
+   }
+
+   return false;
+}
+
+static void*
+on_thread(void *arg)
+{
+   assert(arg);
+   struct chck_tqueue_worker *worker = arg;
+   struct chck_tasks *tasks = worker->tasks;
+
+   size_t idle = 0;
+   while (!__atomic_load_n(&tasks->cancel, __ATOMIC_ACQUIRE)) {
+      size_t l, pos, count;
+      if (!(count = dequeue_any(worker, &l, &pos))) {
+         // spilled tasks are only looked at when the rings are empty
+         if (tasks->growth && work_overflow(worker)) {
+            idle = 0;
+            continue;
+         }
+
+         if (idle++ < tasks->spin) {
+            if (!(idle % 16))
+               sched_yield();
+            continue;
+         }
+
+         park(worker);
+         idle = 0;
+         continue;
+      }
+
+      idle = 0;
+      struct chck_tqueue_lane *lane = &tasks->lanes[l];
+
+      // one clock read for the claim, and one after each task
+      uint64_t start = 0;
+      if (tasks->stats.enabled) {
+         start = now_ns();
+
+         uint64_t queued = 0;
+         for (size_t i = 0; i < count; ++i)
+            queued += start - lane->stamps[(pos + i) % tasks->qsize];
+
+         stat_add(&worker->stats.queued_ns, queued);
+         stat_add(&worker->stats.tasks, count);
+      }
+
+      for (size_t i = 0; i < count; ++i) {
+         const size_t slot = (pos + i) % tasks->qsize;
+         void *data = get_data(tasks, lane, slot);
+
+         // We only may read race against these. That's okay.
+         // The user should not meddle with the input outside of the callbacks.
+         // And tqueue won't touch the item when worker is working on it.
+         VALGRIND_HG_DISABLE_CHECKING(data, tasks->msize);
+
+         tasks->work(data);
+
+         if (tasks->stats.enabled) {
+            const uint64_t end = now_ns();
+            stat_add(&worker->stats.work_ns, end - start);
+            start = end;
+         }
+
+         __atomic_store_n(&lane->processed[slot], true, __ATOMIC_RELEASE);
+
+         VALGRIND_HG_ENABLE_CHECKING(data, tasks->msize);
+
+         if (tasks->done.enabled)
+            done_push(tasks, l, pos + i);
+      }
+
+      // creator thread may be waiting for this, so it can collect
+      wake_producers(tasks);
+      signal_fd(tasks);
+   }
+
+   return NULL;
+}
+
+static void
+stop(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   if (!tqueue->threads.running)
+      return;
+
+   pthread_mutex_lock(&tqueue->tasks.mutex);
+   __atomic_store_n(&tqueue->tasks.cancel, true, __ATOMIC_RELEASE);
+   for (size_t i = 0; i < tqueue->threads.count; ++i)
+      pthread_cond_signal(&tqueue->tasks.workers[i].cond);
+   pthread_cond_broadcast(&tqueue->tasks.not_full);
+   pthread_mutex_unlock(&tqueue->tasks.mutex);
+
+   // other producers see cancel once they are in, wait for the ones that got in before it
+   while (__atomic_load_n(&tqueue->tasks.producers, __ATOMIC_SEQ_CST))
+      sched_yield();
+
+   for (size_t i = 0; i < tqueue->threads.count; ++i)
+      pthread_join(tqueue->threads.t[i], NULL);
+
+   memset(tqueue->threads.t, 0, sizeof(pthread_t) * tqueue->threads.count);
+   __atomic_store_n(&tqueue->threads.running, false, __ATOMIC_RELEASE);
+}
+
+static bool
+start(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   if (tqueue->threads.running)
+      return true;
+
+   __atomic_store_n(&tqueue->tasks.cancel, false, __ATOMIC_RELEASE);
+
+   for (size_t i = 0; i < tqueue->threads.count; ++i) {
+      pthread_attr_t attr, *pattr = NULL;
+
+#ifdef __linux__
+      // pin before the thread runs, so nothing of it gets touched on wrong cpu
+      struct chck_tqueue_worker *worker = &tqueue->tasks.workers[i];
+      if (worker->affinity && pthread_attr_init(&attr) == 0) {
+         pattr = &attr;
+         pthread_attr_setaffinity_np(pattr, worker->affinity_size, worker->affinity);
+      }
+#endif
+
+      const int ret = pthread_create(&tqueue->threads.t[i], pattr, on_thread, &tqueue->tasks.workers[i]);
+
+      if (pattr)
+         pthread_attr_destroy(pattr);
+
+      if (ret != 0) {
+         // take down the ones that got started
+         const size_t count = tqueue->threads.count;
+         tqueue->threads.count = i;
+         __atomic_store_n(&tqueue->threads.running, true, __ATOMIC_RELEASE);
+         stop(tqueue);
+         tqueue->threads.count = count;
+         return false;
+      }
+   }
+
+   tqueue->threads.idle = false;
+   __atomic_store_n(&tqueue->threads.running, true, __ATOMIC_RELEASE);
+   return true;
+}
+
+static void
+stop_idle(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+   stop(tqueue);
+
+   // other producers may have got tasks in while we were stopping
+   if (uncollected(&tqueue->tasks))
+      start(tqueue);
+}
+
+static void
+stop_if_idle(struct chck_tqueue *tqueue, size_t rcount)
+{
+   assert(tqueue);
+
+   if (rcount) {
+      tqueue->threads.idle = false;
+      return;
+   }
+
+   if (tqueue->tasks.growth)
+      shrink(&tqueue->tasks);
+
+   if (!tqueue->threads.keep_alive) {
+      stop_idle(tqueue);
+      return;
+   }
+
+   if (!tqueue->threads.idle_timeout || !tqueue->threads.running)
+      return;
+
+   // workers are kept alive, until there has been nothing to do for idle_timeout
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+
+   // tasks that were added and finished between two collects don't show up in rcount, but they do here
+   size_t added = 0;
+   for (size_t l = 0; l < tqueue->tasks.nlanes; ++l)
+      added += __atomic_load_n(&tqueue->tasks.lanes[l].nadded, __ATOMIC_RELAXED);
+
+   if (!tqueue->threads.idle || added != tqueue->threads.idle_added) {
+      tqueue->threads.idle = true;
+      tqueue->threads.idle_since = now;
+      tqueue->threads.idle_added = added;
+      return;
+   }
+
+   const uint64_t elapsed = (uint64_t)(now.tv_sec - tqueue->threads.idle_since.tv_sec) * 1000000 + (now.tv_nsec - tqueue->threads.idle_since.tv_nsec) / 1000;
+
+   if (elapsed >= tqueue->threads.idle_timeout)
+      stop_idle(tqueue);
+}
+
+static bool
+can_progress(struct chck_tqueue *tqueue, struct chck_tqueue_lane *lane, bool creator, bool spill)
+{
+   assert(tqueue && lane);
+
+   if (__atomic_load_n(&tqueue->tasks.cancel, __ATOMIC_SEQ_CST))
+      return true;
+
+   if (tqueue->tasks.growth) {
+      const size_t count = __atomic_load_n(&lane->overflow.count, __ATOMIC_SEQ_CST);
+
+      if (spill && (!tqueue->tasks.limit || count < tqueue->tasks.limit))
+         return true;
+
+      // ring can't be used before the spilled tasks are collected, creator collects them itself
+      if (count) {
+         if (!creator || __atomic_load_n(&lane->head, __ATOMIC_SEQ_CST) != __atomic_load_n(&lane->tail, __ATOMIC_SEQ_CST))
+            return (creator && __atomic_load_n(&lane->processed[lane->head % tqueue->tasks.qsize], __ATOMIC_SEQ_CST));
+
+         pthread_mutex_lock(&lane->overflow.mutex);
+         const bool ready = (lane->overflow.head != lane->overflow.tail && __atomic_load_n(&lane->overflow.first->state[lane->overflow.head % tqueue->tasks.qsize], __ATOMIC_SEQ_CST) == 2);
+         pthread_mutex_unlock(&lane->overflow.mutex);
+         return ready;
+      }
+   }
+
+   const size_t head = __atomic_load_n(&lane->head, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&lane->tail, __ATOMIC_SEQ_CST) - head < tqueue->tasks.qsize)
+      return true;
+
+   // finished tasks in completion queue, collecting them may free the slot
+   if (tqueue->tasks.done.enabled && __atomic_load_n(&tqueue->tasks.done.head, __ATOMIC_SEQ_CST) != __atomic_load_n(&tqueue->tasks.done.tail, __ATOMIC_SEQ_CST))
+      return true;
+
+   // creator thread frees the slots itself
+   return (creator && __atomic_load_n(&lane->processed[head % tqueue->tasks.qsize], __ATOMIC_SEQ_CST));
+}
+
+static size_t
+depth(const struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   // tail is loaded last, so that racing worker can't make thead pass it
+   size_t depth = 0;
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      const size_t thead = __atomic_load_n(&tasks->lanes[l].thead, __ATOMIC_ACQUIRE);
+      const size_t tail = __atomic_load_n(&tasks->lanes[l].tail, __ATOMIC_ACQUIRE);
+      depth += (tail > thead ? tail - thead : 0) + __atomic_load_n(&tasks->lanes[l].overflow.pending, __ATOMIC_ACQUIRE);
+   }
+
+   return depth;
+}
+
+static void
+update_max_depth(struct chck_tasks *tasks)
+{
+   assert(tasks);
+
+   const size_t current = depth(tasks);
+   size_t max = __atomic_load_n(&tasks->stats.max_depth, __ATOMIC_RELAXED);
+   while (current > max && !__atomic_compare_exchange_n(&tasks->stats.max_depth, &max, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static size_t
+push_tasks(struct chck_tqueue *tqueue, size_t l, const void *data, size_t n, bool block, const struct timespec *deadline, size_t *out_pos, bool creator)
+{
+   assert(tqueue && (data || n == 1));
+
+   struct chck_tqueue_lane *lane = &tqueue->tasks.lanes[l];
+
+   bool timed_out = false;
+   size_t added = 0;
+   while (added < n) {
+      if (__atomic_load_n(&tqueue->tasks.cancel, __ATOMIC_ACQUIRE))
+         break;
+
+      // while there are spilled tasks, new ones spill too, so they are not collected before the older ones
+      // reservations need slot in the ring, so they wait for the spilled tasks to be collected
+      size_t count = 0, pos;
+      const void *next = (data ? data + added * tqueue->tasks.msize : NULL);
+      if (tqueue->tasks.growth && __atomic_load_n(&lane->overflow.count, __ATOMIC_ACQUIRE)) {
+         if (next && (count = overflow_push(&tqueue->tasks, lane, next, n - added))) {
+            added += count;
+            wake_worker(&tqueue->tasks, count);
+            continue;
+         }
+      } else if (!(count = enqueue(&tqueue->tasks, lane, next, n - added, &pos)) && tqueue->tasks.growth && next) {
+         if ((count = overflow_push(&tqueue->tasks, lane, next, n - added))) {
+            added += count;
+            wake_worker(&tqueue->tasks, count);
+            continue;
+         }
+      }
+
+      if (count) {
+         added += count;
+
+         if (tqueue->tasks.stats.enabled)
+            update_max_depth(&tqueue->tasks);
+
+         if (out_pos)
+            *out_pos = pos;
+
+         if (data)
+            wake_worker(&tqueue->tasks, count);
+         continue;
+      }
+
+      if (creator) {
+         // collecting everything stops the threads
+         chck_tqueue_collect(tqueue);
+
+         if (!tqueue->threads.running && !start(tqueue))
+            break;
+
+         const size_t spilled = __atomic_load_n(&lane->overflow.count, __ATOMIC_RELAXED);
+         if (!spilled && __atomic_load_n(&lane->tail, __ATOMIC_RELAXED) - __atomic_load_n(&lane->head, __ATOMIC_RELAXED) < tqueue->tasks.qsize)
+            continue;
+
+         if (spilled && data && tqueue->tasks.limit && spilled < tqueue->tasks.limit)
+            continue;
+      } else if (tqueue->tasks.done.enabled) {
+         // with completion queue any thread can free the slots, nobody else may be collecting
+         collect_completed(&tqueue->tasks);
+
+         if (__atomic_load_n(&lane->tail, __ATOMIC_RELAXED) - __atomic_load_n(&lane->head, __ATOMIC_RELAXED) < tqueue->tasks.qsize)
+            continue;
+      }
+
+      if (!block || timed_out)
+         break;
+
+      pthread_mutex_lock(&tqueue->tasks.mutex);
+      __atomic_add_fetch(&tqueue->tasks.waiters, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+      if (!can_progress(tqueue, lane, creator, (data != NULL))) {
+         const uint64_t start = (tqueue->tasks.stats.enabled ? now_ns() : 0);
+
+         if (deadline)
+            timed_out = (pthread_cond_timedwait(&tqueue->tasks.not_full, &tqueue->tasks.mutex, deadline) == ETIMEDOUT);
+         else
+            pthread_cond_wait(&tqueue->tasks.not_full, &tqueue->tasks.mutex);
+
+         // many producers may be blocked at once
+         if (tqueue->tasks.stats.enabled)
+            __atomic_add_fetch(&tqueue->tasks.stats.blocked_ns, now_ns() - start, __ATOMIC_RELAXED);
+      }
+
+      __atomic_sub_fetch(&tqueue->tasks.waiters, 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&tqueue->tasks.mutex);
+   }
+
+   return added;
+}
+
+static size_t
+add_task(struct chck_tqueue *tqueue, size_t l, const void *data, size_t n, bool block, const struct timespec *deadline, size_t *out_pos)
+{
+   assert(tqueue && (data || n == 1));
+
+   if (l >= tqueue->tasks.nlanes)
+      return 0;
+
+   // only creator starts and stops the workers, other threads can't add while they are stopped
+   if (tqueue->threads.self == pthread_self()) {
+      if (!tqueue->threads.running && !start(tqueue))
+         return 0;
+
+      return push_tasks(tqueue, l, data, n, block, deadline, out_pos, true);
+   }
+
+   // pairs with stop, either it waits for us, or we see cancel
+   size_t added = 0;
+   __atomic_add_fetch(&tqueue->tasks.producers, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&tqueue->threads.running, __ATOMIC_SEQ_CST) && !__atomic_load_n(&tqueue->tasks.cancel, __ATOMIC_SEQ_CST))
+      added = push_tasks(tqueue, l, data, n, block, deadline, out_pos, false);
+   __atomic_sub_fetch(&tqueue->tasks.producers, 1, __ATOMIC_SEQ_CST);
+   return added;
+}
+
+bool
+chck_tqueue_add_task(struct chck_tqueue *tqueue, void *data, useconds_t block)
+{
+   assert(tqueue && data);
+   return (add_task(tqueue, 0, data, 1, (block > 0), NULL, NULL) == 1);
+}
+
+bool
+chck_tqueue_add_task_lane(struct chck_tqueue *tqueue, size_t lane, void *data, useconds_t block)
+{
+   assert(tqueue && data);
+   return (add_task(tqueue, lane, data, 1, (block > 0), NULL, NULL) == 1);
+}
+
+size_t
+chck_tqueue_add_tasks(struct chck_tqueue *tqueue, const void *data, size_t n, useconds_t block)
+{
+   assert(tqueue && data);
+
+   if (!n)
+      return 0;
+
+   return add_task(tqueue, 0, data, n, (block > 0), NULL, NULL);
+}
+
+void*
+chck_tqueue_reserve(struct chck_tqueue *tqueue, size_t lane, useconds_t block, struct chck_tqueue_reservation *out_reservation)
+{
+   assert(tqueue && out_reservation);
+
+   size_t pos;
+   if (add_task(tqueue, lane, NULL, 1, (block > 0), NULL, &pos) != 1)
+      return NULL;
+
+   out_reservation->lane = lane;
+   out_reservation->position = pos;
+   return (out_reservation->data = get_data(&tqueue->tasks, &tqueue->tasks.lanes[lane], pos % tqueue->tasks.qsize));
+}
+
+void
+chck_tqueue_commit(struct chck_tqueue *tqueue, const struct chck_tqueue_reservation *reservation)
+{
+   assert(tqueue && reservation && reservation->lane < tqueue->tasks.nlanes);
+
+   struct chck_tqueue_lane *lane = &tqueue->tasks.lanes[reservation->lane];
+
+   if (lane->stamps)
+      lane->stamps[reservation->position % tqueue->tasks.qsize] = now_ns();
+
+   __atomic_store_n(&lane->sequence[reservation->position % tqueue->tasks.qsize], reservation->position + 1, __ATOMIC_RELEASE);
+   __atomic_add_fetch(&lane->nadded, 1, __ATOMIC_RELAXED);
+   wake_worker(&tqueue->tasks, 1);
+}
+
+bool
+chck_tqueue_add_task_timeout(struct chck_tqueue *tqueue, void *data, useconds_t timeout)
+{
+   assert(tqueue && data);
+
+   if (!timeout)
+      return (add_task(tqueue, 0, data, 1, false, NULL, NULL) == 1);
+
+   struct timespec deadline;
+   clock_gettime(CLOCK_MONOTONIC, &deadline);
+   deadline.tv_sec += timeout / 1000000;
+   deadline.tv_nsec += (long)(timeout % 1000000) * 1000;
+
+   if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+   }
+
+   return (add_task(tqueue, 0, data, 1, true, &deadline, NULL) == 1);
+}
+
+static void
+finish(struct chck_tasks *tasks, void *data)
+{
+   assert(tasks && data);
+
+   VALGRIND_HG_DISABLE_CHECKING(data, tasks->msize);
+
+   if (tasks->callback)
+      tasks->callback(data);
+
+   // slot is overwritten by the next task anyway, clear it only so destructor never sees stale data
+   if (tasks->destructor) {
+      tasks->destructor(data);
+      memset(data, 0, tasks->msize);
+   }
+   VALGRIND_HG_ENABLE_CHECKING(data, tasks->msize);
+}
+
+static bool
+collect_overflow(struct chck_tasks *tasks, struct chck_tqueue_lane *lane)
+{
+   assert(tasks && lane);
+
+   // Only we move the head and free the chunks, so they can be read without the lock.
+   // Callbacks are ran unlocked, they may add more tasks.
+   size_t collected = 0;
+   while (__atomic_load_n(&lane->overflow.count, __ATOMIC_ACQUIRE)) {
+      pthread_mutex_lock(&lane->overflow.mutex);
+      struct chck_tqueue_chunk *first = lane->overflow.first;
+      const size_t start = lane->overflow.head, tail = lane->overflow.tail;
+      pthread_mutex_unlock(&lane->overflow.mutex);
+
+      // stop at the end of chunk, or at first task that is not processed
+      size_t head = start;
+      while (head != tail) {
+         const size_t i = head % tasks->qsize;
+         if (__atomic_load_n(&first->state[i], __ATOMIC_ACQUIRE) != 2)
+            break;
+
+         finish(tasks, first->items + i * tasks->msize);
+         first->state[i] = 0;
+
+         if (++head % tasks->qsize == 0)
+            break;
+      }
+
+      if (head == start)
+         break;
+
+      pthread_mutex_lock(&lane->overflow.mutex);
+      lane->overflow.head = head;
+
+      if (head % tasks->qsize == 0) {
+         // keep one chunk around for the next one
+         if ((lane->overflow.first = first->next) == NULL)
+            lane->overflow.last = lane->overflow.work = NULL;
+
+         if (!lane->overflow.spare) {
+            lane->overflow.spare = first;
+         } else {
+            free(first);
+         }
+      }
+
+      __atomic_store_n(&lane->overflow.count, lane->overflow.tail - head, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&lane->overflow.mutex);
+      collected += head - start;
+   }
+
+   __atomic_add_fetch(&lane->ncollected, collected, __ATOMIC_RELAXED);
+   return (collected > 0);
+}
+
+static bool
+reclaim(struct chck_tasks *tasks, struct chck_tqueue_lane *lane)
+{
+   assert(tasks && lane);
+
+   // Slots can be only freed in order, reclaim from the head as far as everything is collected.
+   size_t head = lane->head;
+   while (head != __atomic_load_n(&lane->tail, __ATOMIC_ACQUIRE)) {
+      const size_t i = head % tasks->qsize;
+      if (!__atomic_load_n(&lane->collected[i], __ATOMIC_ACQUIRE))
+         break;
+
+      __atomic_store_n(&lane->collected[i], false, __ATOMIC_RELAXED);
+      __atomic_store_n(&lane->processed[i], false, __ATOMIC_RELAXED);
+      __atomic_store_n(&lane->sequence[i], head + tasks->qsize, __ATOMIC_RELEASE);
+      ++head;
+   }
+
+   if (head == lane->head)
+      return false;
+
+   __atomic_add_fetch(&lane->ncollected, head - lane->head, __ATOMIC_RELAXED);
+   __atomic_store_n(&lane->head, head, __ATOMIC_SEQ_CST);
+   return true;
+}
+
+static size_t
+collect_completed(struct chck_tasks *tasks)
+{
+   assert(tasks && tasks->done.enabled);
+
+   size_t l, position;
+   while (done_pop(tasks, &l, &position)) {
+      const size_t i = position % tasks->qsize;
+      finish(tasks, get_data(tasks, &tasks->lanes[l], i));
+      __atomic_store_n(&tasks->lanes[l].collected[i], true, __ATOMIC_RELEASE);
+   }
+
+   pthread_mutex_lock(&tasks->done.mutex);
+
+   bool advanced = false;
+   for (l = 0; l < tasks->nlanes; ++l)
+      advanced |= reclaim(tasks, &tasks->lanes[l]);
+
+   pthread_mutex_unlock(&tasks->done.mutex);
+
+   if (advanced)
+      wake_producers(tasks);
+
+   return uncollected(tasks);
+}
+
+size_t
+chck_tqueue_collect_completed(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   if (!tqueue || !tqueue->tasks.done.enabled)
+      return 0;
+
+   drain_fd(&tqueue->tasks);
+
+   return collect_completed(&tqueue->tasks);
+}
+
+size_t
+chck_tqueue_collect(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   // For simplicity, we only allow collection on creator thread.
+   // Other threads may collect only through completion queue.
+   if (!tqueue || !creator_thread(tqueue))
+      return 0;
+
+   drain_fd(&tqueue->tasks);
+
+   if (tqueue->tasks.done.enabled) {
+      const size_t rcount = collect_completed(&tqueue->tasks);
+      stop_if_idle(tqueue, rcount);
+      return rcount;
+   }
+
+   bool advanced = false;
+   struct chck_tasks *tasks = &tqueue->tasks;
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      struct chck_tqueue_lane *lane = &tasks->lanes[l];
+
+      // Only we move the head, and we can't enter inside until the thread is done with the item.
+      // Slots are freed from the head, so we stop at first item that is still being worked on.
+      size_t head = lane->head;
+      while (true) {
+         const size_t i = head % tasks->qsize;
+         if (!__atomic_load_n(&lane->processed[i], __ATOMIC_ACQUIRE))
+            break;
+
+         finish(tasks, get_data(tasks, lane, i));
+         __atomic_store_n(&lane->processed[i], false, __ATOMIC_RELAXED);
+
+         // free the slot for the next lap
+         __atomic_store_n(&lane->sequence[i], head + tasks->qsize, __ATOMIC_RELEASE);
+         ++head;
+      }
+
+      if (head != lane->head) {
+         __atomic_add_fetch(&lane->ncollected, head - lane->head, __ATOMIC_RELAXED);
+         __atomic_store_n(&lane->head, head, __ATOMIC_SEQ_CST);
+         advanced = true;
+      }
+
+      // spilled tasks were added after everything in the ring
+      if (tasks->growth && head == __atomic_load_n(&lane->tail, __ATOMIC_SEQ_CST) && collect_overflow(tasks, lane))
+         advanced = true;
+   }
+
+   if (advanced)
+      wake_producers(tasks);
+
+   const size_t rcount = uncollected(tasks);
+   stop_if_idle(tqueue, rcount);
+   return rcount;
+}
+
+void
+chck_tqueue_release(struct chck_tqueue *tqueue)
+{
+   // Allowed only on creator thread.
+   if (!tqueue || (tqueue->threads.self && !creator_thread(tqueue)))
+      return;
+
+   stop(tqueue);
+   done_release(&tqueue->tasks);
+   pthread_mutex_destroy(&tqueue->tasks.mutex);
+   pthread_cond_destroy(&tqueue->tasks.not_full);
+
+   if (tqueue->tasks.workers) {
+      for (size_t i = 0; i < tqueue->threads.count; ++i) {
+         pthread_cond_destroy(&tqueue->tasks.workers[i].cond);
+#ifdef __linux__
+         set_affinity(&tqueue->tasks.workers[i], NULL, 0);
+#endif
+      }
+   }
+
+   lanes_release(&tqueue->tasks);
+
+   if (tqueue->tasks.fd >= 0)
+      close(tqueue->tasks.fd);
+
+   free(tqueue->tasks.workers);
+   free(tqueue->tasks.parked);
+   free(tqueue->threads.t);
+   memset(tqueue, 0, sizeof(struct chck_tqueue));
+}
+
+void
+chck_tqueue_set_fd(struct chck_tqueue *tqueue, int fd)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread.
+   if (!tqueue || !creator_thread(tqueue))
+      return;
+
+   if (tqueue->tasks.fd >= 0)
+      close(tqueue->tasks.fd);
+
+   tqueue->tasks.fd = dup(fd);
+   __atomic_store_n(&tqueue->tasks.signaled, false, __ATOMIC_RELEASE);
+}
+
+bool
+chck_tqueue_set_completion(struct chck_tqueue *tqueue, bool enabled)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return false;
+
+   if (tqueue->tasks.done.enabled == enabled)
+      return true;
+
+   // spilled tasks are not tracked by the completion queue
+   if (enabled && tqueue->tasks.growth)
+      return false;
+
+   if (!enabled) {
+      done_release(&tqueue->tasks);
+      return true;
+   }
+
+   // tasks may not be left uncollected when changing the mode
+   if (uncollected(&tqueue->tasks))
+      return false;
+
+   return done(&tqueue->tasks);
+}
+
+bool
+chck_tqueue_set_lanes(struct chck_tqueue *tqueue, size_t nlanes, size_t starve)
+{
+   assert(tqueue && nlanes > 0);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running || !nlanes)
+      return false;
+
+   // tasks may not be left uncollected when changing the lanes
+   if (uncollected(&tqueue->tasks))
+      return false;
+
+   if (nlanes != tqueue->tasks.nlanes) {
+      const bool completion = tqueue->tasks.done.enabled;
+      done_release(&tqueue->tasks);
+      lanes_release(&tqueue->tasks);
+
+      if (!lanes(&tqueue->tasks, nlanes) || (completion && !done(&tqueue->tasks))) {
+         // keep the queue usable
+         lanes_release(&tqueue->tasks);
+         lanes(&tqueue->tasks, 1);
+         return false;
+      }
+   }
+
+   tqueue->tasks.starve = starve;
+   return true;
+}
+
+bool
+chck_tqueue_get_lane_stats(const struct chck_tqueue *tqueue, size_t lane, struct chck_tqueue_lane_stats *out_stats)
+{
+   assert(tqueue && out_stats);
+
+   if (lane >= tqueue->tasks.nlanes)
+      return false;
+
+   struct chck_tqueue_lane *l = &tqueue->tasks.lanes[lane];
+   const size_t head = __atomic_load_n(&l->head, __ATOMIC_ACQUIRE);
+   const size_t thead = __atomic_load_n(&l->thead, __ATOMIC_ACQUIRE);
+   const size_t tail = __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE);
+
+   out_stats->added = __atomic_load_n(&l->nadded, __ATOMIC_RELAXED);
+   out_stats->collected = __atomic_load_n(&l->ncollected, __ATOMIC_RELAXED);
+   out_stats->queued = (tail > thead ? tail - thead : 0) + __atomic_load_n(&l->overflow.pending, __ATOMIC_ACQUIRE);
+   out_stats->uncollected = (tail > head ? tail - head : 0) + __atomic_load_n(&l->overflow.count, __ATOMIC_ACQUIRE);
+   return true;
+}
+
+bool
+chck_tqueue_set_growth(struct chck_tqueue *tqueue, bool enabled, size_t limit)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running || (enabled && tqueue->tasks.done.enabled))
+      return false;
+
+   // spilled tasks would not be collected anymore
+   if (!enabled && tqueue->tasks.growth && uncollected(&tqueue->tasks))
+      return false;
+
+   if (!enabled)
+      shrink(&tqueue->tasks);
+
+   tqueue->tasks.growth = enabled;
+   tqueue->tasks.limit = limit;
+   return true;
+}
+
+bool
+chck_tqueue_set_stats(struct chck_tqueue *tqueue, bool enabled)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return false;
+
+   struct chck_tasks *tasks = &tqueue->tasks;
+
+   // queued tasks would not have stamps
+   if (enabled && !tasks->stats.enabled && depth(tasks))
+      return false;
+
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      struct chck_tqueue_lane *lane = &tasks->lanes[l];
+
+      if (!enabled) {
+         free(lane->stamps);
+         lane->stamps = NULL;
+      } else if (!lane->stamps && !(lane->stamps = chck_calloc_of(tasks->qsize, sizeof(uint64_t)))) {
+         return false;
+      }
+   }
+
+   memset(&tasks->stats, 0, sizeof(tasks->stats));
+   for (size_t i = 0; i < tqueue->threads.count; ++i)
+      memset(&tasks->workers[i].stats, 0, sizeof(tasks->workers[i].stats));
+
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      tasks->stats.added += tasks->lanes[l].nadded;
+      tasks->stats.collected += tasks->lanes[l].ncollected;
+   }
+
+   tasks->stats.since = now_ns();
+   tasks->stats.enabled = enabled;
+   return true;
+}
+
+bool
+chck_tqueue_get_stats(const struct chck_tqueue *tqueue, struct chck_tqueue_stats *out_stats)
+{
+   assert(tqueue && out_stats);
+
+   const struct chck_tasks *tasks = &tqueue->tasks;
+   if (!tasks->stats.enabled)
+      return false;
+
+   memset(out_stats, 0, sizeof(struct chck_tqueue_stats));
+
+   for (size_t l = 0; l < tasks->nlanes; ++l) {
+      out_stats->enqueued += __atomic_load_n(&tasks->lanes[l].nadded, __ATOMIC_RELAXED);
+      out_stats->collected += __atomic_load_n(&tasks->lanes[l].ncollected, __ATOMIC_RELAXED);
+   }
+
+   for (size_t i = 0; i < tqueue->threads.count; ++i) {
+      const struct chck_tqueue_worker *worker = &tasks->workers[i];
+      out_stats->dequeued += __atomic_load_n(&worker->stats.tasks, __ATOMIC_RELAXED);
+      out_stats->work_ns += __atomic_load_n(&worker->stats.work_ns, __ATOMIC_RELAXED);
+      out_stats->queued_ns += __atomic_load_n(&worker->stats.queued_ns, __ATOMIC_RELAXED);
+   }
+
+   out_stats->enqueued -= tasks->stats.added;
+   out_stats->collected -= tasks->stats.collected;
+   out_stats->depth = depth(tasks);
+   out_stats->max_depth = __atomic_load_n(&tasks->stats.max_depth, __ATOMIC_RELAXED);
+   out_stats->blocked_ns = __atomic_load_n(&tasks->stats.blocked_ns, __ATOMIC_RELAXED);
+   out_stats->elapsed_ns = now_ns() - tasks->stats.since;
+   return true;
+}
+
+bool
+chck_tqueue_get_worker_stats(const struct chck_tqueue *tqueue, size_t worker, struct chck_tqueue_worker_stats *out_stats)
+{
+   assert(tqueue && out_stats);
+
+   if (!tqueue->tasks.stats.enabled || worker >= tqueue->threads.count)
+      return false;
+
+   const struct chck_tqueue_worker *w = &tqueue->tasks.workers[worker];
+   out_stats->tasks = __atomic_load_n(&w->stats.tasks, __ATOMIC_RELAXED);
+   out_stats->work_ns = __atomic_load_n(&w->stats.work_ns, __ATOMIC_RELAXED);
+   out_stats->queued_ns = __atomic_load_n(&w->stats.queued_ns, __ATOMIC_RELAXED);
+   return true;
+}
+
+bool
+chck_tqueue_start(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread.
+   if (!tqueue || !creator_thread(tqueue))
+      return false;
+
+   return start(tqueue);
+}
+
+void
+chck_tqueue_stop(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread.
+   if (!tqueue || !creator_thread(tqueue))
+      return;
+
+   stop(tqueue);
+}
+
+void
+chck_tqueue_set_keep_alive(struct chck_tqueue *tqueue, bool keep_alive, useconds_t idle_timeout)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread.
+   if (!tqueue || !creator_thread(tqueue))
+      return;
+
+   tqueue->threads.keep_alive = keep_alive;
+   tqueue->threads.idle_timeout = idle_timeout;
+   tqueue->threads.idle = false;
+}
+
+#ifdef __linux__
+struct relocate {
+   struct chck_tasks *tasks;
+   size_t nlanes;
+   bool completion, result;
+};
+
+static void*
+relocate(void *arg)
+{
+   assert(arg);
+
+   // Runs pinned to the node, pages are placed on the node that first touches them.
+   struct relocate *r = arg;
+   r->result = lanes(r->tasks, r->nlanes) && (!r->completion || done(r->tasks));
+
+   if (r->result) {
+      for (size_t l = 0; l < r->tasks->nlanes; ++l) {
+         struct chck_tqueue_lane *lane = &r->tasks->lanes[l];
+         memset(lane->buffer, 0, r->tasks->qsize * r->tasks->msize);
+         memset(lane->processed, 0, r->tasks->qsize * sizeof(bool));
+      }
+   }
+
+   return NULL;
+}
+#endif
+
+bool
+chck_tqueue_set_cpus(struct chck_tqueue *tqueue, const size_t *cpus, size_t ncpus)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running || (ncpus && !cpus))
+      return false;
+
+#ifdef __linux__
+   for (size_t i = 0; i < tqueue->threads.count; ++i) {
+      if (!set_affinity(&tqueue->tasks.workers[i], (ncpus ? &cpus[i % ncpus] : NULL), (ncpus ? 1 : 0)))
+         return false;
+   }
+
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool
+chck_tqueue_set_numa_spread(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return false;
+
+#ifdef __linux__
+   size_t nodes[MAX_NODES], nnodes;
+   if (!(nnodes = read_list("/sys/devices/system/node/online", nodes, MAX_NODES)))
+      return false;
+
+   size_t *cpus;
+   if (!(cpus = chck_calloc_of(MAX_CPUS, sizeof(size_t))))
+      return false;
+
+   bool ret = true;
+   for (size_t i = 0; i < tqueue->threads.count && ret; ++i) {
+      const size_t ncpus = read_node_cpus(nodes[i % nnodes], cpus, MAX_CPUS);
+      ret = (ncpus > 0 && set_affinity(&tqueue->tasks.workers[i], cpus, ncpus));
+   }
+
+   free(cpus);
+   return ret;
+#else
+   return false;
+#endif
+}
+
+bool
+chck_tqueue_set_numa_node(struct chck_tqueue *tqueue, size_t node)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return false;
+
+   // the queue memory is allocated again
+   if (uncollected(&tqueue->tasks))
+      return false;
+
+#ifdef __linux__
+   size_t *cpus, ncpus;
+   if (!(cpus = chck_calloc_of(MAX_CPUS, sizeof(size_t))))
+      return false;
+
+   bool ret = false;
+   struct chck_tqueue_worker pin = {0};
+   if (!(ncpus = read_node_cpus(node, cpus, MAX_CPUS)) || !set_affinity(&pin, cpus, ncpus))
+      goto out;
+
+   for (size_t i = 0; i < tqueue->threads.count; ++i) {
+      if (!set_affinity(&tqueue->tasks.workers[i], cpus, ncpus))
+         goto out;
+   }
+
+   struct relocate r = {
+      .tasks = &tqueue->tasks,
+      .nlanes = tqueue->tasks.nlanes,
+      .completion = tqueue->tasks.done.enabled,
+   };
+
+   pthread_attr_t attr;
+   if (pthread_attr_init(&attr) != 0)
+      goto out;
+
+   pthread_attr_setaffinity_np(&attr, pin.affinity_size, pin.affinity);
+
+   done_release(&tqueue->tasks);
+   lanes_release(&tqueue->tasks);
+
+   pthread_t thread;
+   if (pthread_create(&thread, &attr, relocate, &r) == 0)
+      pthread_join(thread, NULL);
+
+   pthread_attr_destroy(&attr);
+
+   if (!(ret = r.result)) {
+      // keep the queue usable
+      lanes_release(&tqueue->tasks);
+      if (lanes(&tqueue->tasks, r.nlanes) && r.completion)
+         done(&tqueue->tasks);
+   }
+
+out:
+   set_affinity(&pin, NULL, 0);
+   free(cpus);
+   return ret;
+#else
+   (void)node;
+   return false;
+#endif
+}
+
+void
+chck_tqueue_set_spin(struct chck_tqueue *tqueue, size_t spin)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return;
+
+   tqueue->tasks.spin = spin;
+}
+
+void
+chck_tqueue_set_batch(struct chck_tqueue *tqueue, size_t batch)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread, before the workers are running.
+   if (!tqueue || !creator_thread(tqueue) || tqueue->threads.running)
+      return;
+
+   batch = (batch > tqueue->tasks.qsize ? tqueue->tasks.qsize : batch);
+   tqueue->tasks.batch = (batch > 0 ? batch : 1);
+}
+
+int
+chck_tqueue_get_fd(struct chck_tqueue *tqueue)
+{
+   assert(tqueue);
+
+   // Allowed only on creator thread.
+   if (!tqueue || !creator_thread(tqueue))
+      return -1;
+
+   return tqueue->tasks.fd;
+}
+
+bool
+chck_tqueue(struct chck_tqueue *tqueue, size_t nthreads, size_t qsize, size_t msize, void (*work)(), void (*callback)(), void (*destructor)())
+{
+   assert(tqueue && work && msize > 0);
+   memset(tqueue, 0, sizeof(struct chck_tqueue));
+   tqueue->tasks.fd = -1;
+
+   if (!msize || !work || !qsize)
+      return false;
+
+   // With single slot, free and published sequence numbers would be the same.
+   qsize = (qsize < 2 ? 2 : qsize);
+
+   tqueue->tasks.msize = msize;
+   tqueue->tasks.qsize = qsize;
+
+   if (!lanes(&tqueue->tasks, 1))
+      goto fail;
+
+   // timeouts are measured with monotonic clock
+   pthread_condattr_t attr;
+   if (pthread_condattr_init(&attr) != 0)
+      goto fail;
+
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+   if (pthread_mutex_init(&tqueue->tasks.mutex, NULL) != 0 ||
+       pthread_cond_init(&tqueue->tasks.not_full, &attr) != 0) {
+      pthread_condattr_destroy(&attr);
+      goto fail;
+   }
+
+   pthread_condattr_destroy(&attr);
+
+   if (!(tqueue->threads.t = chck_calloc_of(nthreads, sizeof(pthread_t))) ||
+       !(tqueue->tasks.workers = chck_calloc_of(nthreads, sizeof(struct chck_tqueue_worker))) ||
+       !(tqueue->tasks.parked = chck_calloc_of(nthreads, sizeof(size_t))))
+      goto fail;
+
+   for (size_t i = 0; i < nthreads; ++i) {
+      tqueue->tasks.workers[i].tasks = &tqueue->tasks;
+      pthread_cond_init(&tqueue->tasks.workers[i].cond, NULL);
+   }
+
+   tqueue->threads.self = pthread_self();
+   tqueue->threads.count = nthreads;
+   tqueue->tasks.spin = 128;
+   tqueue->tasks.batch = 1;
    tqueue->tasks.work = work;
    tqueue->tasks.callback = callback;
    tqueue->tasks.destructor = destructor;
@@ -5,20 +5,174 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct chck_tqueue_worker {
+   struct chck_tasks *tasks;
+
+   // each worker parks on its own condition, so wakes are targeted
+   pthread_cond_t cond;
+   bool woken;
+
+   // number of times worker has claimed tasks, used for starvation protection
+   size_t claims;
+
+   // cpu set the worker is pinned to (cpu_set_t on linux), or NULL
+   void *affinity;
+   size_t affinity_size;
+
+   // written only by the worker, and only when stats are enabled
+   struct {
+      uint64_t tasks, work_ns, queued_ns;
+   } stats;
+};
+
+struct chck_tqueue_chunk {
+   struct chck_tqueue_chunk *next;
+
+   // qsize tasks, and state of each (0 = queued, 1 = being worked on, 2 = processed)
+   void *items;
+   unsigned char *state;
+};
+
+struct chck_tqueue_lane {
+   void *buffer;
+   bool *processed;
+
+   // sequence number for each slot, tells which position the slot is free for, or holds
+   size_t *sequence;
+
+   // slots that have been collected through completion queue, but not yet reclaimed (head is reclaimed in order)
+   bool *collected;
+
+   // time each slot was published, only when stats are enabled
+   uint64_t *stamps;
+
+   // positions only ever increase, the slot for position is (position % qsize)
+   // head is next to be collected, thead next to be worked on and tail next to be enqueued
+   // different threads hammer these, so keep them in own cache lines
+   char pad0[CHCK_CACHE_LINE];
+   size_t head;
+   char pad1[CHCK_CACHE_LINE - sizeof(size_t)];
+   size_t thead;
+   char pad2[CHCK_CACHE_LINE - sizeof(size_t)];
+   size_t tail;
+   char pad3[CHCK_CACHE_LINE - sizeof(size_t)];
+
+   // number of tasks added to and collected from the lane
+   size_t nadded, ncollected;
+
+   // tasks that did not fit in the ring when growth is enabled, in chain of chunks of qsize tasks
+   // first chunk has the head, work the thead and last the tail, positions count from the start of first chunk
+   // count (tail - head) and pending (tail - thead) can be read without the mutex
+   struct {
+      struct chck_tqueue_chunk *first, *work, *last, *spare;
+      size_t head, thead, tail;
+      size_t count, pending;
+      pthread_mutex_t mutex;
+   } overflow;
+};
+
+struct chck_tqueue_lane_stats {
+   // total number of tasks added to and collected from the lane
+   size_t added, collected;
+
+   // tasks waiting for worker, and tasks worked on or waiting for collection
+   size_t queued, uncollected;
+};
+
+struct chck_tqueue_reservation {
+   // slot reserved by chck_tqueue_reserve
+   void *data;
+   size_t lane, position;
+};
+
+struct chck_tqueue_stats {
+   // tasks added, taken by workers and collected
+   uint64_t enqueued, dequeued, collected;
+
+   // tasks waiting for worker right now, and the most there has been
+   size_t depth, max_depth;
+
+   // total time tasks waited for worker and spent in work, and producers spent blocked on full queue
+   uint64_t queued_ns, work_ns, blocked_ns;
+
+   // time since the stats were enabled
+   uint64_t elapsed_ns;
+};
+
+struct chck_tqueue_worker_stats {
+   // tasks ran by the worker, time spent in them and the time they waited for worker
+   // work_ns / elapsed_ns of chck_tqueue_stats is the utilisation of the worker
+   uint64_t tasks, work_ns, queued_ns;
+};
 
 struct chck_tqueue {
    struct chck_tasks {
-      void *buffer;
-      bool *processed;
+      // lane 0 has the highest priority, each lane is own ring of qsize slots
+      struct chck_tqueue_lane *lanes;
+      size_t nlanes;
+
+      // every starve'th claim of worker looks at the lanes in reverse order (0 = never)
+      size_t starve;
+
       void (*work)();
       void (*callback)();
       void (*destructor)();
       size_t msize;
       size_t qsize;
-      size_t head, thead, tail, count, tcount;
+
+      // maximum number of tasks worker claims at once
+      size_t batch;
+
+      // tasks spill over the ring when it's full, up to limit (0 = unbounded) tasks for each lane
+      size_t limit;
+      bool growth;
+
+      // number of workers waiting for tasks and producers waiting for free slots
+      // the mutex and conditions are only used for sleeping
+      size_t sleepers, waiters;
+
+      // producers other than creator currently adding tasks, stopping waits for them
+      size_t producers;
       pthread_mutex_t mutex;
-      pthread_cond_t notify;
+      pthread_cond_t not_full;
+
+      // parked workers (stack of indices to workers), and how many times idle worker polls before parking
+      struct chck_tqueue_worker *workers;
+      size_t *parked;
+      size_t spin;
+
+      // optional completion queue, workers push lanes and positions of finished tasks in it
+      // so they can be collected from any thread and out of order
+      // the size is qsize * nlanes, there can't be more tasks in flight
+      struct {
+         size_t *lanes, *positions, *sequence;
+         size_t size;
+
+         char pad0[CHCK_CACHE_LINE];
+         size_t head;
+         char pad1[CHCK_CACHE_LINE - sizeof(size_t)];
+         size_t tail;
+         char pad2[CHCK_CACHE_LINE - sizeof(size_t)];
+
+         // held while reclaiming slots
+         pthread_mutex_t mutex;
+         bool enabled;
+      } done;
+
+      // optional instrumentation, see chck_tqueue_set_stats
+      // lane counters are not reset, so the values they had when stats were enabled are kept
+      struct {
+         uint64_t since, blocked_ns, added, collected;
+         size_t max_depth;
+         bool enabled;
+      } stats;
+
+      // fd is written only when signaled goes from false to true, collect clears it
       int fd;
+      bool signaled;
       bool cancel;
    } tasks;
 
@@ -26,12 +180,104 @@ struct chck_tqueue {
       pthread_t *t;
       pthread_t self;
       size_t count;
+
+      // with keep alive, collect stops the threads only after there has been nothing to do for idle_timeout
+      // idle_added is the number of tasks added when idle_since was stamped
+      struct timespec idle_since;
+      size_t idle_added;
+      useconds_t idle_timeout;
+      bool keep_alive, idle;
       bool running;
    } threads;
 };
 
+/**
+ * Thread queue runs work(data) for the added tasks on its worker threads.
+ * Once task is done, callback(data) and destructor(data) are ran on the creator thread by chck_tqueue_collect.
+ *
+ * Tasks are passed in lock free bounded ring (sequence numbered slots), so producers and workers don't contend on a lock.
+ * Tasks may be added from any thread, collect/release/fd functions may only be called from the creator thread.
+ * Only the creator thread starts the workers (adding a task starts them) and stops them (collect stops them once everything is collected).
+ * Adding from other threads fails while the workers are stopped, so use chck_tqueue_start with keep alive, or make sure creator has tasks in flight.
+ * Tasks are collected in the order they were added (within lane).
+ *
+ * qsize smaller than 2 is rounded up to 2.
+ *
+ * When the queue is full and block is non-zero, chck_tqueue_add_task sleeps until a slot is freed.
+ * (the value of block is not used as interval anymore, any non-zero value blocks)
+ * On creator thread, the call collects finished tasks itself, other threads are woken up by chck_tqueue_collect.
+ * With completion queue, other threads collect the finished tasks themselves too, so they don't depend on the creator collecting.
+ * chck_tqueue_add_task_timeout is the same, but gives up after timeout microseconds.
+ *
+ * chck_tqueue_add_tasks adds n tasks from the data array, claiming as many slots as are free at once.
+ * Returns the number of tasks added, which is less than n only if block is 0 and the queue got full.
+ * chck_tqueue_set_batch lets workers claim up to batch tasks at once (default 1), so small tasks don't pay synchronization each.
+ * Batching trades some load balancing for throughput, and may only be set while the workers are not running.
+ *
+ * chck_tqueue_set_completion enables completion queue, which workers push finished tasks into.
+ * chck_tqueue_collect_completed may then be called from any thread (also many at once), it runs callback and destructor for finished tasks in the order they finished.
+ * Cost is relative to number of finished tasks, not the queue size. Returns number of tasks that are still not collected.
+ * chck_tqueue_collect works with completion queue too, but only there the workers are stopped when everything is collected.
+ * Completion queue may only be set while the workers are not running.
+ *
+ * Idle worker polls the queue spin times (default 128), before it parks itself. Producers wake only as many parked workers as they added tasks.
+ * chck_tqueue_set_spin changes the spin count, 0 parks immediately. Spinning lowers the wake up latency at cost of CPU time.
+ * The fd is written only once until it's drained by collect, so there is no syscall for each finished task.
+ *
+ * Workers are started by the first added task, and by default chck_tqueue_collect stops them when everything is collected.
+ * chck_tqueue_set_keep_alive keeps them parked instead, idle_timeout (0 = forever) is the time without tasks after which collect still stops them.
+ * chck_tqueue_start and chck_tqueue_stop start and stop the workers explicitly, stop leaves the tasks that were not worked on in the queue.
+ *
+ * chck_tqueue_set_lanes splits the queue to priority lanes, each with qsize slots. Lane 0 has the highest priority.
+ * Workers take tasks from the highest priority lane that has any, except every starve'th claim, which prefers the lowest priority lanes, so they are never starved.
+ * chck_tqueue_add_task_lane adds to given lane, the other add functions add to lane 0. Lanes can only be set while the queue is empty and workers are not running.
+ * chck_tqueue_get_lane_stats returns counters for the lane.
+ *
+ * chck_tqueue_reserve reserves slot in the lane and returns pointer to it, so the task can be written in place instead of copied in.
+ * The slot has whatever was left there by the previous task (zeroed only when there is a destructor), fill all of it.
+ * The task is handed to workers with chck_tqueue_commit, every reservation must be committed, as workers can't get past uncommitted slot.
+ *
+ * chck_tqueue_set_growth lets the queue grow past qsize under bursts. When ring of the lane is full, tasks spill over to chunks of qsize tasks.
+ * Workers pick spilled tasks once the ring has nothing for them, and they are collected after the tasks in the ring, so the order is kept.
+ * limit caps the spilled tasks for each lane (0 = unbounded), past that the queue is full as usual. The chunks are freed once the queue is idle.
+ * Spilled tasks are slower to hand over than the ring (they go through lock), so qsize should still fit the usual load.
+ * Growth can't be used with completion queue, chck_tqueue_reserve does not spill over, and it may only be set while the workers are not running.
+ *
+ * chck_tqueue_set_stats enables counters and timings (off by default, and may only be set while the workers are not running).
+ * They cost a clock read for each added batch and each task ran, so keep them off when nobody looks at them. Enabling again resets them.
+ * chck_tqueue_get_stats and chck_tqueue_get_worker_stats return snapshot of them from any thread, the fields are read one by one, so they may be slightly out of sync.
+ *
+ * chck_tqueue_set_cpus pins worker i to cpus[i % ncpus], ncpus 0 removes the pinning.
+ * chck_tqueue_set_numa_spread distributes workers round robin over the NUMA nodes, and pins each to the cpus of its node.
+ * chck_tqueue_set_numa_node pins all workers to one node, and places the queue memory on that node.
+ * For queue per node, create tqueue for each node with chck_tqueue_set_numa_node, and add tasks to the queue of the node where their data is.
+ * These may only be set while workers are not running, and the node functions also only when the queue is empty.
+ * Affinity is only supported on linux, elsewhere the functions return false.
+ */
+
 CHCK_NONULL bool chck_tqueue_add_task(struct chck_tqueue *tqueue, void *data, useconds_t block);
+CHCK_NONULL bool chck_tqueue_add_task_lane(struct chck_tqueue *tqueue, size_t lane, void *data, useconds_t block);
+CHCK_NONULL size_t chck_tqueue_add_tasks(struct chck_tqueue *tqueue, const void *data, size_t n, useconds_t block);
+CHCK_NONULL void* chck_tqueue_reserve(struct chck_tqueue *tqueue, size_t lane, useconds_t block, struct chck_tqueue_reservation *out_reservation);
+CHCK_NONULL void chck_tqueue_commit(struct chck_tqueue *tqueue, const struct chck_tqueue_reservation *reservation);
+CHCK_NONULL bool chck_tqueue_add_task_timeout(struct chck_tqueue *tqueue, void *data, useconds_t timeout);
 CHCK_NONULL size_t chck_tqueue_collect(struct chck_tqueue *tqueue);
+CHCK_NONULL size_t chck_tqueue_collect_completed(struct chck_tqueue *tqueue);
+CHCK_NONULL bool chck_tqueue_set_completion(struct chck_tqueue *tqueue, bool enabled);
+CHCK_NONULL bool chck_tqueue_start(struct chck_tqueue *tqueue);
+CHCK_NONULL void chck_tqueue_stop(struct chck_tqueue *tqueue);
+CHCK_NONULL void chck_tqueue_set_keep_alive(struct chck_tqueue *tqueue, bool keep_alive, useconds_t idle_timeout);
+CHCK_NONULL bool chck_tqueue_set_lanes(struct chck_tqueue *tqueue, size_t nlanes, size_t starve);
+CHCK_NONULL bool chck_tqueue_get_lane_stats(const struct chck_tqueue *tqueue, size_t lane, struct chck_tqueue_lane_stats *out_stats);
+CHCK_NONULL bool chck_tqueue_set_growth(struct chck_tqueue *tqueue, bool enabled, size_t limit);
+CHCK_NONULL bool chck_tqueue_set_stats(struct chck_tqueue *tqueue, bool enabled);
+CHCK_NONULL bool chck_tqueue_get_stats(const struct chck_tqueue *tqueue, struct chck_tqueue_stats *out_stats);
+CHCK_NONULL bool chck_tqueue_get_worker_stats(const struct chck_tqueue *tqueue, size_t worker, struct chck_tqueue_worker_stats *out_stats);
+CHCK_NONULLV(1) bool chck_tqueue_set_cpus(struct chck_tqueue *tqueue, const size_t *cpus, size_t ncpus);
+CHCK_NONULL bool chck_tqueue_set_numa_spread(struct chck_tqueue *tqueue);
+CHCK_NONULL bool chck_tqueue_set_numa_node(struct chck_tqueue *tqueue, size_t node);
+CHCK_NONULL void chck_tqueue_set_spin(struct chck_tqueue *tqueue, size_t spin);
+CHCK_NONULL void chck_tqueue_set_batch(struct chck_tqueue *tqueue, size_t batch);
 CHCK_NONULL void chck_tqueue_set_fd(struct chck_tqueue *tqueue, int fd);
 CHCK_NONULL int chck_tqueue_get_fd(struct chck_tqueue *tqueue);
 void chck_tqueue_release(struct chck_tqueue *tqueue);
@@ -1,6 +1,8 @@
 #include "queue.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #ifdef __linux__
 #  include <sys/eventfd.h>
@@ -36,6 +38,104 @@ destructor(struct item *item)
    assert((item->a == 1 && item->c == 2) || (item->a == 2 && item->c == 1));
 }
 
+static size_t worked, collected;
+
+static void
+count_work(struct item *item)
+{
+   assert(item);
+   __atomic_add_fetch(&worked, 1, __ATOMIC_RELAXED);
+}
+
+static void
+count_callback(struct item *item)
+{
+   assert(item && item->a == item->c);
+   __atomic_add_fetch(&collected, 1, __ATOMIC_RELEASE);
+}
+
+static void
+slow_work(struct item *item)
+{
+   assert(item);
+   usleep(100);
+}
+
+static bool gate;
+static size_t order;
+static int next_order;
+
+static void
+gated_work(struct item *item)
+{
+   assert(item);
+   while (!__atomic_load_n(&gate, __ATOMIC_ACQUIRE)) usleep(100);
+}
+
+static void
+order_callback(struct item *item)
+{
+   assert(item && item->a == next_order++);
+}
+
+static void*
+producer(void *arg)
+{
+   struct chck_tqueue *tqueue = arg;
+   for (int i = 0; i < 0xFFFF; ++i)
+      assert(chck_tqueue_add_task(tqueue, (&(struct item){ i, i }), 1));
+   return NULL;
+}
+
+
+static void
+lane_work(struct item *item)
+{
+   assert(item);
+
+   // first task holds the worker, until everything is queued
+   if (item->a == 2)
+      while (!__atomic_load_n(&gate, __ATOMIC_ACQUIRE)) usleep(100);
+
+   item->c = __atomic_fetch_add(&order, 1, __ATOMIC_RELAXED);
+}
+
+static void
+lane_callback(struct item *item)
+{
+   assert(item);
+
+   // high priority tasks get past the bulk ones
+   if (item->a == 0)
+      assert(item->c < 8);
+}
+
+static void*
+consumer(void *arg)
+{
+   struct chck_tqueue *tqueue = arg;
+   while (__atomic_load_n(&collected, __ATOMIC_ACQUIRE) < 0xFFFF) {
+      if (!chck_tqueue_collect_completed(tqueue))
+         usleep(100);
+   }
+   return NULL;
+}
+
+static void*
+timeout_producer(void *arg)
+{
+   struct chck_tqueue *tqueue = arg;
+   assert(!chck_tqueue_add_task_timeout(tqueue, (&(struct item){ 1, 10 }), 1000));
+   return NULL;
+}
+
+static void*
+single_producer(void *arg)
+{
+   struct chck_tqueue *tqueue = arg;
+   return (void*)(intptr_t)chck_tqueue_add_task(tqueue, (&(struct item){ 1, 10 }), 0);
+}
+
 int main(void)
 {
    /* TEST: thread pools */
@@ -106,5 +206,360 @@ out:
       chck_tqueue_release(&tqueue);
    }
 
+   /* TEST: blocking on full queue */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 4, sizeof(struct item), work, callback, destructor));
+
+      // park right away, so workers go through sleep and wake up all the time
+      chck_tqueue_set_spin(&tqueue, 0);
+
+      for (size_t i = 0; i < 0xFFFF; ++i) {
+         struct item a = { 1, 10 };
+         assert(chck_tqueue_add_task(&tqueue, &a, 1));
+      }
+
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: timeout on full queue */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 1, 2, sizeof(struct item), work, callback, destructor));
+      assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 1, 10 }), 0));
+      assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 2, 5 }), 0));
+
+      // nobody collects, so the other thread has to give up
+      pthread_t thread;
+      assert(pthread_create(&thread, NULL, timeout_producer, &tqueue) == 0);
+      pthread_join(thread, NULL);
+
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: other threads can't add while workers are stopped */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 1, 2, sizeof(struct item), work, callback, destructor));
+
+      void *ret;
+      pthread_t thread;
+      assert(pthread_create(&thread, NULL, single_producer, &tqueue) == 0);
+      pthread_join(thread, &ret);
+      assert(!ret);
+
+      assert(chck_tqueue_start(&tqueue));
+      assert(pthread_create(&thread, NULL, single_producer, &tqueue) == 0);
+      pthread_join(thread, &ret);
+      assert(ret);
+
+      // collecting everything stops the workers again
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      assert(!tqueue.threads.running);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: batches */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 4, 64, sizeof(struct item), work, callback, destructor));
+      chck_tqueue_set_batch(&tqueue, 8);
+
+      struct item items[100];
+      for (size_t i = 0; i < 100; ++i)
+         items[i] = (i & 1 ? (struct item){ 2, 5 } : (struct item){ 1, 10 });
+
+      // without blocking, only what fits (or what creator could collect meanwhile) is added
+      const size_t added = chck_tqueue_add_tasks(&tqueue, items, 100, 0);
+      assert(added >= 64 && added <= 100);
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+
+      for (size_t i = 0; i < 0xFFF; ++i)
+         assert(chck_tqueue_add_tasks(&tqueue, items, 100, 1) == 100);
+
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: reserve and commit */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 8, sizeof(struct item), count_work, count_callback, NULL));
+
+      // commit out of order, workers wait for the first slot
+      struct chck_tqueue_reservation r[3];
+      struct item *items[3];
+      for (int i = 0; i < 3; ++i) {
+         assert((items[i] = chck_tqueue_reserve(&tqueue, 0, 0, &r[i])));
+         items[i]->a = items[i]->c = i;
+      }
+
+      chck_tqueue_commit(&tqueue, &r[2]);
+      chck_tqueue_commit(&tqueue, &r[1]);
+      usleep(1000);
+      assert(!__atomic_load_n(&worked, __ATOMIC_RELAXED));
+      chck_tqueue_commit(&tqueue, &r[0]);
+
+      for (int i = 0; i < 0xFFFF; ++i) {
+         struct chck_tqueue_reservation reservation;
+         struct item *item;
+         assert((item = chck_tqueue_reserve(&tqueue, 0, 1, &reservation)));
+         item->a = item->c = i;
+         chck_tqueue_commit(&tqueue, &reservation);
+      }
+
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      assert(worked == 0xFFFF + 3 && collected == 0xFFFF + 3);
+
+      struct chck_tqueue_reservation reservation;
+      assert(!chck_tqueue_reserve(&tqueue, 1, 0, &reservation));
+      chck_tqueue_release(&tqueue);
+      worked = collected = 0;
+   }
+
+   /* TEST: growth */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 4, sizeof(struct item), gated_work, order_callback, NULL));
+      assert(chck_tqueue_set_growth(&tqueue, true, 8));
+
+      // workers hold on to their tasks, so only the ring and the limit fit
+      gate = false;
+      next_order = 0;
+      int added = 0;
+      while (chck_tqueue_add_task(&tqueue, (&(struct item){ added, 0 }), 0))
+         ++added;
+      assert(added == 4 + 8);
+
+      __atomic_store_n(&gate, true, __ATOMIC_RELEASE);
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+      assert(next_order == added);
+
+      // unbounded, bursts never block
+      assert(!tqueue.threads.running);
+      assert(chck_tqueue_set_growth(&tqueue, true, 0));
+      gate = false;
+      next_order = 0;
+
+      for (int i = 0; i < 1000; ++i)
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ i, 0 }), 0));
+
+      struct chck_tqueue_lane_stats lstats;
+      assert(chck_tqueue_get_lane_stats(&tqueue, 0, &lstats));
+      assert(lstats.uncollected == 1000);
+
+      __atomic_store_n(&gate, true, __ATOMIC_RELEASE);
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+      assert(next_order == 1000);
+
+      // shrunk back once idle
+      assert(!tqueue.tasks.lanes[0].overflow.first && !tqueue.tasks.lanes[0].overflow.spare);
+      assert(!chck_tqueue_set_completion(&tqueue, true));
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: growth with multiple producers */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 2, sizeof(struct item), count_work, count_callback, NULL));
+      assert(chck_tqueue_set_growth(&tqueue, true, 64));
+      chck_tqueue_set_keep_alive(&tqueue, true, 0);
+      assert(chck_tqueue_start(&tqueue));
+
+      pthread_t producers[2];
+      for (size_t i = 0; i < 2; ++i)
+         assert(pthread_create(&producers[i], NULL, producer, &tqueue) == 0);
+
+      // producers block on the limit, until we collect
+      while (__atomic_load_n(&collected, __ATOMIC_ACQUIRE) < 2 * 0xFFFF) {
+         chck_tqueue_collect(&tqueue);
+         usleep(10);
+      }
+
+      for (size_t i = 0; i < 2; ++i)
+         pthread_join(producers[i], NULL);
+
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+      assert(worked == 2 * 0xFFFF && collected == 2 * 0xFFFF);
+      chck_tqueue_release(&tqueue);
+      worked = collected = 0;
+   }
+
+   /* TEST: stats */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 4, sizeof(struct item), slow_work, NULL, NULL));
+
+      struct chck_tqueue_stats stats;
+      assert(!chck_tqueue_get_stats(&tqueue, &stats));
+      assert(chck_tqueue_set_stats(&tqueue, true));
+
+      for (int i = 0; i < 32; ++i)
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ i, i }), 1));
+
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+
+      assert(chck_tqueue_get_stats(&tqueue, &stats));
+      assert(stats.enqueued == 32 && stats.dequeued == 32 && stats.collected == 32);
+      assert(stats.depth == 0 && stats.max_depth > 0 && stats.max_depth <= 4);
+
+      // each task sleeps 100us, and the creator had to wait for room
+      assert(stats.work_ns >= 32 * 100000 && stats.queued_ns > 0);
+      assert(stats.blocked_ns > 0 && stats.elapsed_ns >= stats.work_ns / 2);
+
+      uint64_t tasks = 0;
+      struct chck_tqueue_worker_stats wstats;
+      for (size_t i = 0; i < 2; ++i) {
+         assert(chck_tqueue_get_worker_stats(&tqueue, i, &wstats));
+         assert(wstats.work_ns >= wstats.tasks * 100000);
+         tasks += wstats.tasks;
+      }
+      assert(tasks == 32);
+      assert(!chck_tqueue_get_worker_stats(&tqueue, 2, &wstats));
+
+      // enabling again resets
+      assert(chck_tqueue_set_stats(&tqueue, true));
+      assert(chck_tqueue_get_stats(&tqueue, &stats));
+      assert(stats.enqueued == 0 && stats.dequeued == 0 && stats.max_depth == 0);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: keep alive */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 4, sizeof(struct item), work, callback, destructor));
+      chck_tqueue_set_keep_alive(&tqueue, true, 0);
+      assert(chck_tqueue_start(&tqueue));
+
+      for (size_t burst = 0; burst < 4; ++burst) {
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 1, 10 }), 1));
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 2, 5 }), 1));
+         while (chck_tqueue_collect(&tqueue)) usleep(100);
+         assert(tqueue.threads.running);
+      }
+
+      // idle timeout
+      chck_tqueue_set_keep_alive(&tqueue, true, 1000);
+      assert(!chck_tqueue_collect(&tqueue));
+      usleep(2000);
+
+      // burst that is done before the next collect still resets the timeout
+      assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 1, 10 }), 1));
+      usleep(10000);
+      assert(!chck_tqueue_collect(&tqueue));
+      assert(tqueue.threads.running);
+
+      usleep(2000);
+      assert(!chck_tqueue_collect(&tqueue));
+      assert(!tqueue.threads.running);
+
+      // stopped queue keeps the tasks, and finishes them when started again
+      assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 1, 10 }), 1));
+      chck_tqueue_stop(&tqueue);
+      assert(chck_tqueue_start(&tqueue));
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+      chck_tqueue_release(&tqueue);
+   }
+
+   /* TEST: priority lanes */
+   {
+      // first task must hold the worker, earlier tests leave the gate open
+      gate = false;
+      order = 0;
+
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 1, 64, sizeof(struct item), lane_work, lane_callback, NULL));
+      assert(chck_tqueue_set_lanes(&tqueue, 2, 4));
+      assert(!chck_tqueue_add_task_lane(&tqueue, 2, (&(struct item){ 0, 0 }), 0));
+
+      assert(chck_tqueue_add_task_lane(&tqueue, 1, (&(struct item){ 2, 0 }), 0));
+      for (size_t i = 0; i < 32; ++i)
+         assert(chck_tqueue_add_task_lane(&tqueue, 1, (&(struct item){ 1, 0 }), 0));
+      for (size_t i = 0; i < 4; ++i)
+         assert(chck_tqueue_add_task_lane(&tqueue, 0, (&(struct item){ 0, 0 }), 0));
+
+      struct chck_tqueue_lane_stats stats;
+      assert(chck_tqueue_get_lane_stats(&tqueue, 1, &stats));
+      assert(stats.added == 33 && stats.uncollected == 33);
+
+      __atomic_store_n(&gate, true, __ATOMIC_RELEASE);
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+
+      assert(chck_tqueue_get_lane_stats(&tqueue, 0, &stats));
+      assert(stats.added == 4 && stats.collected == 4 && !stats.queued && !stats.uncollected);
+      assert(chck_tqueue_get_lane_stats(&tqueue, 1, &stats));
+      assert(stats.added == 33 && stats.collected == 33);
+      chck_tqueue_release(&tqueue);
+   }
+
+#ifdef __linux__
+   /* TEST: affinity */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 2, 4, sizeof(struct item), work, callback, destructor));
+      assert(chck_tqueue_set_cpus(&tqueue, (size_t[]){ 0 }, 1));
+
+      // not all systems expose the nodes
+      if (chck_tqueue_set_numa_spread(&tqueue))
+         assert(chck_tqueue_set_numa_node(&tqueue, 0));
+
+      for (size_t i = 0; i < 0xFF; ++i) {
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 1, 10 }), 1));
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 2, 5 }), 1));
+      }
+
+      while (chck_tqueue_collect(&tqueue)) usleep(100);
+      assert(chck_tqueue_set_cpus(&tqueue, NULL, 0));
+      chck_tqueue_release(&tqueue);
+   }
+#endif
+
+   /* TEST: completion queue with multiple consumers */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 4, 256, sizeof(struct item), count_work, count_callback, NULL));
+      assert(chck_tqueue_set_completion(&tqueue, true));
+      assert(chck_tqueue_set_lanes(&tqueue, 2, 0));
+
+      pthread_t consumers[2];
+      for (size_t i = 0; i < 2; ++i)
+         assert(pthread_create(&consumers[i], NULL, consumer, &tqueue) == 0);
+
+      // creator does not collect, the consumers free the slots
+      for (int i = 0; i < 0xFFFF; ++i)
+         assert(chck_tqueue_add_task(&tqueue, (&(struct item){ i, i }), 1));
+
+      for (size_t i = 0; i < 2; ++i)
+         pthread_join(consumers[i], NULL);
+
+      assert(collected == 0xFFFF);
+      assert(!chck_tqueue_collect(&tqueue));
+      chck_tqueue_release(&tqueue);
+      worked = collected = 0;
+   }
+
+   /* TEST: multiple producers and workers */
+   {
+      struct chck_tqueue tqueue;
+      assert(chck_tqueue(&tqueue, 8, 4 * 0xFFFF + 1, sizeof(struct item), count_work, count_callback, NULL));
+
+      // first task starts the workers
+      assert(chck_tqueue_add_task(&tqueue, (&(struct item){ 0, 0 }), 0));
+
+      pthread_t producers[4];
+      for (size_t i = 0; i < 4; ++i)
+         assert(pthread_create(&producers[i], NULL, producer, &tqueue) == 0);
+
+      for (size_t i = 0; i < 4; ++i)
+         pthread_join(producers[i], NULL);
+
+      while (chck_tqueue_collect(&tqueue)) usleep(1000);
+      assert(worked == 4 * 0xFFFF + 1);
+      assert(collected == 4 * 0xFFFF + 1);
+      chck_tqueue_release(&tqueue);
+   }
+
    return EXIT_SUCCESS;
 }
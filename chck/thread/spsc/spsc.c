@@ -0,0 +1,201 @@
+#include "spsc.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+static bool
+round_capacity(size_t capacity, size_t *out_capacity)
+{
+   assert(out_capacity);
+
+   size_t v = 1;
+   while (v < capacity) {
+      if (unlikely(chck_mul_ofsz(v, 2, &v)))
+         return false;
+   }
+
+   *out_capacity = v;
+   return true;
+}
+
+size_t
+chck_spsc_ring_size(size_t capacity, size_t msize)
+{
+   size_t sz;
+   if (unlikely(!msize) || unlikely(!round_capacity(capacity, &capacity)) ||
+       unlikely(chck_mul_ofsz(capacity, msize, &sz)) || unlikely(chck_add_ofsz(sz, sizeof(struct chck_spsc_ring), &sz)))
+      return 0;
+
+   return sz;
+}
+
+static void
+copy_in(struct chck_spsc *spsc, size_t position, const void *data, size_t n)
+{
+   assert(spsc && data);
+
+   // at most two copies, the run may wrap around the end of the ring
+   const size_t index = position & spsc->mask;
+   const size_t first = (n < spsc->mask + 1 - index ? n : spsc->mask + 1 - index);
+   memcpy(spsc->buffer + index * spsc->msize, data, first * spsc->msize);
+
+   if (n > first)
+      memcpy(spsc->buffer, data + first * spsc->msize, (n - first) * spsc->msize);
+}
+
+static void
+copy_out(struct chck_spsc *spsc, size_t position, void *data, size_t n)
+{
+   assert(spsc && data);
+
+   const size_t index = position & spsc->mask;
+   const size_t first = (n < spsc->mask + 1 - index ? n : spsc->mask + 1 - index);
+   memcpy(data, spsc->buffer + index * spsc->msize, first * spsc->msize);
+
+   if (n > first)
+      memcpy(data + first * spsc->msize, spsc->buffer, (n - first) * spsc->msize);
+}
+
+size_t
+chck_spsc_push_many(struct chck_spsc *spsc, const void *data, size_t n)
+{
+   assert(spsc && spsc->ring && data);
+   struct chck_spsc_ring *ring = spsc->ring;
+
+   // only producer writes tail and cached_head
+   const size_t tail = ring->tail;
+   size_t space = ring->capacity - (tail - ring->cached_head);
+
+   if (space < n) {
+      ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      space = ring->capacity - (tail - ring->cached_head);
+   }
+
+   if (n > space)
+      n = space;
+
+   if (!n)
+      return 0;
+
+   copy_in(spsc, tail, data, n);
+   __atomic_store_n(&ring->tail, tail + n, __ATOMIC_RELEASE);
+   return n;
+}
+
+bool
+chck_spsc_push(struct chck_spsc *spsc, const void *data)
+{
+   return chck_spsc_push_many(spsc, data, 1);
+}
+
+size_t
+chck_spsc_pop_many(struct chck_spsc *spsc, void *out_data, size_t n)
+{
+   assert(spsc && spsc->ring && out_data);
+   struct chck_spsc_ring *ring = spsc->ring;
+
+   // only consumer writes head and cached_tail
+   const size_t head = ring->head;
+   size_t avail = ring->cached_tail - head;
+
+   if (avail < n) {
+      ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      avail = ring->cached_tail - head;
+   }
+
+   if (n > avail)
+      n = avail;
+
+   if (!n)
+      return 0;
+
+   copy_out(spsc, head, out_data, n);
+   __atomic_store_n(&ring->head, head + n, __ATOMIC_RELEASE);
+   return n;
+}
+
+bool
+chck_spsc_pop(struct chck_spsc *spsc, void *out_data)
+{
+   return chck_spsc_pop_many(spsc, out_data, 1);
+}
+
+size_t
+chck_spsc_count(const struct chck_spsc *spsc)
+{
+   assert(spsc && spsc->ring);
+
+   // may be stale by the time it's returned, unless called from the side that would grow it
+   const size_t head = __atomic_load_n(&spsc->ring->head, __ATOMIC_ACQUIRE);
+   const size_t tail = __atomic_load_n(&spsc->ring->tail, __ATOMIC_ACQUIRE);
+   return tail - head;
+}
+
+void
+chck_spsc_release(struct chck_spsc *spsc)
+{
+   if (!spsc)
+      return;
+
+   if (spsc->owned)
+      free(spsc->ring);
+
+   memset(spsc, 0, sizeof(struct chck_spsc));
+}
+
+bool
+chck_spsc_from_memory(struct chck_spsc *spsc, void *memory, size_t size, size_t capacity, size_t msize, bool init)
+{
+   assert(spsc && memory);
+   memset(spsc, 0, sizeof(struct chck_spsc));
+
+   struct chck_spsc_ring *ring = memory;
+
+   if (init) {
+      size_t needed;
+      if (unlikely(!(needed = chck_spsc_ring_size(capacity, msize))) || unlikely(size < needed))
+         return false;
+
+      memset(ring, 0, sizeof(struct chck_spsc_ring));
+      round_capacity(capacity, &ring->capacity);
+      ring->msize = msize;
+   } else {
+      // attach, make sure the ring is sane and fits in what we were given
+      size_t needed;
+      if (unlikely(size < sizeof(struct chck_spsc_ring)) ||
+          unlikely(!ring->capacity) || unlikely(!ring->msize) ||
+          unlikely(ring->capacity & (ring->capacity - 1)) ||
+          unlikely(!(needed = chck_spsc_ring_size(ring->capacity, ring->msize))) || unlikely(size < needed))
+         return false;
+   }
+
+   spsc->ring = ring;
+   spsc->buffer = memory + sizeof(struct chck_spsc_ring);
+   spsc->mask = ring->capacity - 1;
+   spsc->msize = ring->msize;
+   return true;
+}
+
+bool
+chck_spsc(struct chck_spsc *spsc, size_t capacity, size_t msize)
+{
+   assert(spsc && msize > 0);
+   memset(spsc, 0, sizeof(struct chck_spsc));
+
+   size_t size;
+   if (unlikely(!(size = chck_spsc_ring_size(capacity, msize))))
+      return false;
+
+   void *memory;
+   if (posix_memalign(&memory, CHCK_CACHE_LINE, size) != 0)
+      return false;
+
+   if (!chck_spsc_from_memory(spsc, memory, size, capacity, msize, true)) {
+      free(memory);
+      return false;
+   }
+
+   spsc->owned = true;
+   return true;
+}
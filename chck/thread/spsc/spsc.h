@@ -0,0 +1,57 @@
+#ifndef __chck_spsc__
+#define __chck_spsc__
+
+#include <chck/macros.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct chck_spsc_ring {
+   // constant after init, capacity is power of two
+   size_t capacity, msize;
+   char pad0[CHCK_CACHE_LINE - 2 * sizeof(size_t)];
+
+   // positions only ever increase, the slot for position is (position & (capacity - 1))
+   // producer writes tail and keeps its own copy of head, so it reads the consumer line only when the ring looks full
+   size_t tail, cached_head;
+   char pad1[CHCK_CACHE_LINE - 2 * sizeof(size_t)];
+
+   // consumer writes head and keeps its own copy of tail
+   size_t head, cached_tail;
+   char pad2[CHCK_CACHE_LINE - 2 * sizeof(size_t)];
+
+   // capacity * msize bytes of slots follow
+};
+
+struct chck_spsc {
+   struct chck_spsc_ring *ring;
+   void *buffer;
+   size_t mask, msize;
+
+   // ring was allocated by chck_spsc and is freed on release
+   bool owned;
+};
+
+/**
+ * Wait-free ring for handing fixed size messages from exactly one producer thread to exactly one consumer thread.
+ * There are no locks, each side writes only its own index and reads the other side's index only when its cached copy runs out.
+ * The batch functions move as many messages as fit with single index update, and return the number of messages moved.
+ *
+ * The ring state is self contained and has no pointers, so it can be placed in shared memory for handoff between processes.
+ * chck_spsc_ring_size returns the bytes needed for ring of capacity messages (rounded up to power of two), or 0 on overflow.
+ * chck_spsc_from_memory places new ring in the memory (which should be cache line aligned) when init is true, otherwise it attaches to ring already in there.
+ * chck_spsc allocates the ring itself.
+ *
+ * Neither side blocks, spin or sleep in the caller when the ring is full or empty.
+ */
+
+size_t chck_spsc_ring_size(size_t capacity, size_t msize);
+CHCK_NONULL bool chck_spsc(struct chck_spsc *spsc, size_t capacity, size_t msize);
+CHCK_NONULL bool chck_spsc_from_memory(struct chck_spsc *spsc, void *memory, size_t size, size_t capacity, size_t msize, bool init);
+void chck_spsc_release(struct chck_spsc *spsc);
+CHCK_NONULL bool chck_spsc_push(struct chck_spsc *spsc, const void *data);
+CHCK_NONULL size_t chck_spsc_push_many(struct chck_spsc *spsc, const void *data, size_t n);
+CHCK_NONULL bool chck_spsc_pop(struct chck_spsc *spsc, void *out_data);
+CHCK_NONULL size_t chck_spsc_pop_many(struct chck_spsc *spsc, void *out_data, size_t n);
+CHCK_NONULL size_t chck_spsc_count(const struct chck_spsc *spsc);
+
+#endif /* __chck_spsc__ */
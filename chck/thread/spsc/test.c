@@ -0,0 +1,144 @@
+#include "spsc.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+#define MESSAGES 1000000
+
+static void*
+produce(void *arg)
+{
+   struct chck_spsc *spsc = arg;
+
+   uint64_t batch[37];
+   for (uint64_t i = 0; i < MESSAGES;) {
+      const size_t n = (MESSAGES - i < 37 ? MESSAGES - i : 37);
+      for (size_t b = 0; b < n; ++b)
+         batch[b] = i + b;
+
+      size_t pushed;
+      while (!(pushed = chck_spsc_push_many(spsc, batch, n)))
+         sched_yield();
+
+      // push what did not fit in the next round
+      i += pushed;
+   }
+
+   return NULL;
+}
+
+static void
+consume(struct chck_spsc *spsc)
+{
+   uint64_t batch[53];
+   for (uint64_t expect = 0; expect < MESSAGES;) {
+      size_t n;
+      while (!(n = chck_spsc_pop_many(spsc, batch, 53)))
+         sched_yield();
+
+      for (size_t b = 0; b < n; ++b)
+         assert(batch[b] == expect++);
+   }
+}
+
+int main(void)
+{
+   /* TEST: single thread */
+   {
+      struct chck_spsc spsc;
+      assert(chck_spsc(&spsc, 5, sizeof(uint32_t)));
+      assert(spsc.mask + 1 == 8);
+
+      uint32_t v = 0;
+      assert(!chck_spsc_pop(&spsc, &v));
+
+      for (uint32_t i = 0; i < 8; ++i)
+         assert(chck_spsc_push(&spsc, &i));
+      assert(!chck_spsc_push(&spsc, &v));
+      assert(chck_spsc_count(&spsc) == 8);
+
+      // wrap around
+      uint32_t out[8];
+      assert(chck_spsc_pop_many(&spsc, out, 5) == 5);
+      assert(out[0] == 0 && out[4] == 4);
+
+      const uint32_t in[6] = { 8, 9, 10, 11, 12, 13 };
+      assert(chck_spsc_push_many(&spsc, in, 6) == 5);
+      assert(chck_spsc_pop_many(&spsc, out, 8) == 8);
+
+      for (uint32_t i = 0; i < 8; ++i)
+         assert(out[i] == i + 5);
+
+      assert(chck_spsc_count(&spsc) == 0);
+
+      // attaching to broken ring header fails
+      struct chck_spsc attached;
+      const size_t size = chck_spsc_ring_size(8, sizeof(uint32_t));
+      spsc.ring->capacity = 0;
+      assert(!chck_spsc_from_memory(&attached, spsc.ring, size, 0, 0, false));
+      spsc.ring->capacity = 8;
+      spsc.ring->msize = 0;
+      assert(!chck_spsc_from_memory(&attached, spsc.ring, size, 0, 0, false));
+      spsc.ring->msize = sizeof(uint32_t);
+      assert(chck_spsc_from_memory(&attached, spsc.ring, size, 0, 0, false));
+      chck_spsc_release(&spsc);
+   }
+
+   /* TEST: threads */
+   {
+      struct chck_spsc spsc;
+      assert(chck_spsc(&spsc, 256, sizeof(uint64_t)));
+
+      pthread_t thread;
+      assert(pthread_create(&thread, NULL, produce, &spsc) == 0);
+      consume(&spsc);
+      pthread_join(thread, NULL);
+
+      chck_spsc_release(&spsc);
+   }
+
+   /* TEST: shared memory between processes */
+   {
+      const size_t size = chck_spsc_ring_size(128, sizeof(uint64_t));
+      assert(size > 0);
+      assert(!chck_spsc_ring_size(SIZE_MAX, sizeof(uint64_t)));
+
+      void *memory;
+      assert((memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED);
+
+      struct chck_spsc spsc;
+      assert(!chck_spsc_from_memory(&spsc, memory, size - 1, 128, sizeof(uint64_t), true));
+      assert(chck_spsc_from_memory(&spsc, memory, size, 128, sizeof(uint64_t), true));
+
+      pid_t pid;
+      assert((pid = fork()) >= 0);
+
+      if (pid == 0) {
+         struct chck_spsc child;
+         if (!chck_spsc_from_memory(&child, memory, size, 0, 0, false))
+            _exit(EXIT_FAILURE);
+
+         produce(&child);
+         _exit(EXIT_SUCCESS);
+      }
+
+      consume(&spsc);
+
+      int status;
+      assert(waitpid(pid, &status, 0) == pid);
+      assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+      // releasing ring on memory we gave does not free it
+      chck_spsc_release(&spsc);
+      munmap(memory, size);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,592 @@
+#include "steal.h"
+#include <chck/overflow/overflow.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <assert.h>
+
+// how many times idle worker looks for work before going to sleep
+#define SPIN_ROUNDS 64
+
+struct chck_steal_queue_slot {
+   // must be first, the task pointer is casted back to slot
+   struct chck_steal_task task;
+   struct chck_steal_queue *queue;
+   size_t index;
+   bool processed;
+};
+
+static bool
+deque(struct chck_steal_deque *deque, size_t capacity)
+{
+   assert(deque);
+
+   size_t size = 2;
+   while (size < capacity) {
+      if (unlikely(chck_mul_ofsz(size, 2, &size)))
+         return false;
+   }
+
+   if (!(deque->buffer = chck_calloc_of(size, sizeof(struct chck_steal_task*))))
+      return false;
+
+   deque->mask = size - 1;
+   deque->top = deque->bottom = 0;
+   return true;
+}
+
+static bool
+deque_push(struct chck_steal_deque *deque, struct chck_steal_task *task)
+{
+   assert(deque && task);
+
+   // only the owner calls this
+   const int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+   const int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+
+   if ((size_t)(b - t) > deque->mask)
+      return false;
+
+   __atomic_store_n(&deque->buffer[b & deque->mask], task, __ATOMIC_RELAXED);
+   __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELEASE);
+   return true;
+}
+
+static struct chck_steal_task*
+deque_pop(struct chck_steal_deque *deque)
+{
+   assert(deque);
+
+   // only the owner calls this
+   const int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+   __atomic_store_n(&deque->bottom, b, __ATOMIC_RELAXED);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   int64_t t = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+   if (t > b) {
+      // empty
+      __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+      return NULL;
+   }
+
+   struct chck_steal_task *task = __atomic_load_n(&deque->buffer[b & deque->mask], __ATOMIC_RELAXED);
+
+   if (t == b) {
+      // last item, race against thieves
+      if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+         task = NULL;
+
+      __atomic_store_n(&deque->bottom, b + 1, __ATOMIC_RELAXED);
+   }
+
+   return task;
+}
+
+static struct chck_steal_task*
+deque_steal(struct chck_steal_deque *deque)
+{
+   assert(deque);
+
+   int64_t t = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+   const int64_t b = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+   if (t >= b)
+      return NULL;
+
+   struct chck_steal_task *task = __atomic_load_n(&deque->buffer[t & deque->mask], __ATOMIC_RELAXED);
+
+   // lost the race to the owner or another thief
+   if (!__atomic_compare_exchange_n(&deque->top, &t, t + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      return NULL;
+
+   return task;
+}
+
+static inline bool
+deque_is_empty(struct chck_steal_deque *deque)
+{
+   assert(deque);
+   return (__atomic_load_n(&deque->top, __ATOMIC_SEQ_CST) >= __atomic_load_n(&deque->bottom, __ATOMIC_SEQ_CST));
+}
+
+static inline uint32_t
+xorshift(uint32_t *seed)
+{
+   assert(seed);
+   uint32_t x = *seed;
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   return (*seed = x);
+}
+
+static struct chck_steal_task*
+inject_pop(struct chck_steal *steal)
+{
+   assert(steal);
+
+   if (!__atomic_load_n(&steal->inject.first, __ATOMIC_ACQUIRE))
+      return NULL;
+
+   pthread_mutex_lock(&steal->inject.mutex);
+
+   struct chck_steal_task *task;
+   if ((task = steal->inject.first)) {
+      __atomic_store_n(&steal->inject.first, task->next, __ATOMIC_RELEASE);
+
+      if (!task->next)
+         steal->inject.last = NULL;
+   }
+
+   pthread_mutex_unlock(&steal->inject.mutex);
+   return task;
+}
+
+static void
+inject_push(struct chck_steal *steal, struct chck_steal_task *task)
+{
+   assert(steal && task);
+
+   task->next = NULL;
+   pthread_mutex_lock(&steal->inject.mutex);
+
+   if (steal->inject.last)
+      steal->inject.last->next = task;
+   else
+      __atomic_store_n(&steal->inject.first, task, __ATOMIC_RELEASE);
+
+   steal->inject.last = task;
+   pthread_mutex_unlock(&steal->inject.mutex);
+}
+
+static struct chck_steal_task*
+find_task(struct chck_steal *steal, struct chck_steal_worker *worker, uint32_t *seed)
+{
+   assert(steal && seed);
+
+   struct chck_steal_task *task;
+   if (worker && (task = deque_pop(&worker->deque)))
+      return task;
+
+   if ((task = inject_pop(steal)))
+      return task;
+
+   for (size_t i = 0; i < steal->count * 2; ++i) {
+      struct chck_steal_worker *victim = &steal->workers[xorshift(seed) % steal->count];
+
+      if (victim == worker)
+         continue;
+
+      if ((task = deque_steal(&victim->deque)))
+         return task;
+   }
+
+   return NULL;
+}
+
+static bool
+has_work(struct chck_steal *steal)
+{
+   assert(steal);
+
+   if (__atomic_load_n(&steal->inject.first, __ATOMIC_SEQ_CST))
+      return true;
+
+   for (size_t i = 0; i < steal->count; ++i) {
+      if (!deque_is_empty(&steal->workers[i].deque))
+         return true;
+   }
+
+   return false;
+}
+
+static void
+run(struct chck_steal *steal, struct chck_steal_task *task)
+{
+   assert(steal && task);
+
+   // task may be gone after it has been marked done
+   struct chck_steal_group *group = task->group;
+   task->function(task);
+
+   // group may be gone too, once the waiter sees it finished
+   if (!group || __atomic_sub_fetch(&group->pending, 1, __ATOMIC_SEQ_CST))
+      return;
+
+   // Pairs with the fence in chck_steal_group_wait, either we see the waiter, or the waiter sees the group finished.
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   if (!__atomic_load_n(&steal->waiters, __ATOMIC_RELAXED))
+      return;
+
+   pthread_mutex_lock(&steal->mutex);
+   pthread_cond_broadcast(&steal->notify);
+   pthread_mutex_unlock(&steal->mutex);
+}
+
+static void
+wake_worker(struct chck_steal *steal)
+{
+   assert(steal);
+
+   // Pairs with the fence in on_thread, either we see the sleeper, or the sleeper sees the task.
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+   if (!__atomic_load_n(&steal->sleepers, __ATOMIC_RELAXED))
+      return;
+
+   pthread_mutex_lock(&steal->mutex);
+   pthread_cond_signal(&steal->notify);
+   pthread_mutex_unlock(&steal->mutex);
+}
+
+static void*
+on_thread(void *arg)
+{
+   assert(arg);
+   struct chck_steal_worker *worker = arg;
+   struct chck_steal *steal = worker->steal;
+   pthread_setspecific(steal->key, worker);
+
+   size_t idle = 0;
+   while (!__atomic_load_n(&steal->cancel, __ATOMIC_ACQUIRE)) {
+      struct chck_steal_task *task;
+      if ((task = find_task(steal, worker, &worker->seed))) {
+         run(steal, task);
+         idle = 0;
+         continue;
+      }
+
+      if (++idle < SPIN_ROUNDS) {
+         sched_yield();
+         continue;
+      }
+
+      pthread_mutex_lock(&steal->mutex);
+      __atomic_add_fetch(&steal->sleepers, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+      if (!__atomic_load_n(&steal->cancel, __ATOMIC_ACQUIRE) && !has_work(steal))
+         pthread_cond_wait(&steal->notify, &steal->mutex);
+
+      __atomic_sub_fetch(&steal->sleepers, 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&steal->mutex);
+      idle = 0;
+   }
+
+   return NULL;
+}
+
+void
+chck_steal_spawn(struct chck_steal *steal, struct chck_steal_group *group, struct chck_steal_task *task)
+{
+   assert(steal && task && task->function);
+
+   if (group)
+      __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+
+   task->group = group;
+
+   struct chck_steal_worker *worker;
+   if ((worker = pthread_getspecific(steal->key))) {
+      // deque full, there is plenty of work for others already
+      if (!deque_push(&worker->deque, task)) {
+         run(steal, task);
+         return;
+      }
+   } else {
+      inject_push(steal, task);
+   }
+
+   wake_worker(steal);
+}
+
+void
+chck_steal_group_wait(struct chck_steal *steal, struct chck_steal_group *group)
+{
+   assert(steal && group);
+
+   struct chck_steal_worker *worker = pthread_getspecific(steal->key);
+   uint32_t seed = (worker ? worker->seed : (uint32_t)(uintptr_t)&seed) | 1;
+
+   // help with the work instead of blocking, the tasks we wait for may be in our own deque
+   size_t idle = 0;
+   bool slept = false;
+   while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) {
+      struct chck_steal_task *task;
+      if ((task = find_task(steal, worker, &seed))) {
+         run(steal, task);
+         idle = 0;
+         continue;
+      }
+
+      if (++idle < SPIN_ROUNDS) {
+         sched_yield();
+         continue;
+      }
+
+      // last tasks of the group run elsewhere, sleep like idle worker until they finish or there is more to help with
+      pthread_mutex_lock(&steal->mutex);
+      __atomic_add_fetch(&steal->sleepers, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&steal->waiters, 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+      if (__atomic_load_n(&group->pending, __ATOMIC_SEQ_CST) && !has_work(steal))
+         pthread_cond_wait(&steal->notify, &steal->mutex);
+
+      __atomic_sub_fetch(&steal->waiters, 1, __ATOMIC_RELAXED);
+      __atomic_sub_fetch(&steal->sleepers, 1, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&steal->mutex);
+      slept = true;
+      idle = 0;
+   }
+
+   // we may have taken the wake up of spawn, that was meant for a worker
+   if (slept && has_work(steal))
+      wake_worker(steal);
+}
+
+void
+chck_steal_release(struct chck_steal *steal)
+{
+   if (!steal)
+      return;
+
+   if (steal->workers) {
+      pthread_mutex_lock(&steal->mutex);
+      __atomic_store_n(&steal->cancel, true, __ATOMIC_RELEASE);
+      pthread_cond_broadcast(&steal->notify);
+      pthread_mutex_unlock(&steal->mutex);
+
+      // steal is set only for workers that have thread running
+      for (size_t i = 0; i < steal->count; ++i) {
+         if (steal->workers[i].steal)
+            pthread_join(steal->workers[i].thread, NULL);
+
+         free(steal->workers[i].deque.buffer);
+      }
+
+      pthread_key_delete(steal->key);
+      pthread_cond_destroy(&steal->notify);
+      pthread_mutex_destroy(&steal->mutex);
+      pthread_mutex_destroy(&steal->inject.mutex);
+   }
+
+   free(steal->workers);
+   memset(steal, 0, sizeof(struct chck_steal));
+}
+
+bool
+chck_steal(struct chck_steal *steal, size_t nthreads, size_t capacity)
+{
+   assert(steal && nthreads > 0);
+   memset(steal, 0, sizeof(struct chck_steal));
+
+   if (unlikely(!nthreads))
+      return false;
+
+   if (!(steal->workers = chck_calloc_of(nthreads, sizeof(struct chck_steal_worker))))
+      return false;
+
+   if (pthread_key_create(&steal->key, NULL) != 0) {
+      free(steal->workers);
+      steal->workers = NULL;
+      return false;
+   }
+
+   pthread_mutex_init(&steal->inject.mutex, NULL);
+   pthread_mutex_init(&steal->mutex, NULL);
+   pthread_cond_init(&steal->notify, NULL);
+   steal->count = nthreads;
+
+   // workers steal from each other, so every deque must be ready before any thread starts
+   for (size_t i = 0; i < nthreads; ++i) {
+      if (!deque(&steal->workers[i].deque, capacity))
+         goto fail;
+
+      steal->workers[i].seed = (uint32_t)(i * 2654435761u) | 1;
+   }
+
+   for (size_t i = 0; i < nthreads; ++i) {
+      steal->workers[i].steal = steal;
+      if (pthread_create(&steal->workers[i].thread, NULL, on_thread, &steal->workers[i]) != 0) {
+         steal->workers[i].steal = NULL;
+         goto fail;
+      }
+   }
+
+   return true;
+
+fail:
+   chck_steal_release(steal);
+   return false;
+}
+
+static bool
+creator_thread(const struct chck_steal_queue *queue, const char *function)
+{
+   if (queue->self != pthread_self()) {
+      fprintf(stderr, "chck: Function '%s' should be only called from same thread where steal queue was created in.\n", function);
+      abort();
+      return false;
+   }
+   return true;
+}
+#define creator_thread(x) creator_thread(x, __FUNCTION__)
+
+static void*
+queue_get_data(struct chck_steal_queue *queue, size_t index)
+{
+   assert(queue && queue->buffer);
+
+   if (index >= queue->qsize)
+      return NULL;
+
+   return queue->buffer + (index * queue->msize);
+}
+
+static void
+queue_task(struct chck_steal_task *task)
+{
+   assert(task);
+
+   struct chck_steal_queue_slot *slot = (struct chck_steal_queue_slot*)task;
+   struct chck_steal_queue *queue = slot->queue;
+   queue->work(queue_get_data(queue, slot->index));
+   __atomic_store_n(&slot->processed, true, __ATOMIC_SEQ_CST);
+
+   // either creator sees the task processed, or we see it waiting
+   if (__atomic_load_n(&queue->waiting, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&queue->mutex);
+      pthread_cond_signal(&queue->not_full);
+      pthread_mutex_unlock(&queue->mutex);
+   }
+}
+
+bool
+chck_steal_queue_add_task(struct chck_steal_queue *queue, void *data, useconds_t block)
+{
+   assert(queue && data);
+
+   // Allowed only on creator thread.
+   if (!queue || !creator_thread(queue))
+      return false;
+
+   while (queue->tail - queue->head >= queue->qsize) {
+      if (!block)
+         return false;
+
+      // slots are freed from the head, so wait for the oldest task
+      struct chck_steal_queue_slot *slot = &queue->slots[queue->head % queue->qsize];
+      pthread_mutex_lock(&queue->mutex);
+      __atomic_store_n(&queue->waiting, true, __ATOMIC_SEQ_CST);
+      while (!__atomic_load_n(&slot->processed, __ATOMIC_SEQ_CST))
+         pthread_cond_wait(&queue->not_full, &queue->mutex);
+      __atomic_store_n(&queue->waiting, false, __ATOMIC_RELAXED);
+      pthread_mutex_unlock(&queue->mutex);
+
+      chck_steal_queue_collect(queue);
+   }
+
+   const size_t i = queue->tail % queue->qsize;
+   memcpy(queue_get_data(queue, i), data, queue->msize);
+
+   struct chck_steal_queue_slot *slot = &queue->slots[i];
+   slot->task.function = queue_task;
+   slot->processed = false;
+   ++queue->tail;
+
+   chck_steal_spawn(queue->steal, &queue->group, &slot->task);
+   return true;
+}
+
+size_t
+chck_steal_queue_collect(struct chck_steal_queue *queue)
+{
+   assert(queue);
+
+   // Allowed only on creator thread.
+   if (!queue || !creator_thread(queue))
+      return 0;
+
+   while (queue->head != queue->tail) {
+      const size_t i = queue->head % queue->qsize;
+      if (!__atomic_load_n(&queue->slots[i].processed, __ATOMIC_ACQUIRE))
+         break;
+
+      void *data = queue_get_data(queue, i);
+
+      if (queue->callback)
+         queue->callback(data);
+
+      if (queue->destructor)
+         queue->destructor(data);
+
+      memset(data, 0, queue->msize);
+      ++queue->head;
+   }
+
+   return queue->tail - queue->head;
+}
+
+void
+chck_steal_queue_release(struct chck_steal_queue *queue)
+{
+   // Allowed only on creator thread.
+   if (!queue || (queue->steal && !creator_thread(queue)))
+      return;
+
+   if (queue->steal)
+      chck_steal_group_wait(queue->steal, &queue->group);
+
+   if (queue->destructor && queue->buffer) {
+      for (size_t i = queue->head; i != queue->tail; ++i)
+         queue->destructor(queue_get_data(queue, i % queue->qsize));
+   }
+
+   if (queue->steal) {
+      pthread_cond_destroy(&queue->not_full);
+      pthread_mutex_destroy(&queue->mutex);
+   }
+
+   free(queue->slots);
+   free(queue->buffer);
+   memset(queue, 0, sizeof(struct chck_steal_queue));
+}
+
+bool
+chck_steal_queue(struct chck_steal_queue *queue, struct chck_steal *steal, size_t qsize, size_t msize, void (*work)(), void (*callback)(), void (*destructor)())
+{
+   assert(queue && steal && work && msize > 0);
+   memset(queue, 0, sizeof(struct chck_steal_queue));
+
+   if (!msize || !qsize)
+      return false;
+
+   queue->steal = steal;
+   queue->self = pthread_self();
+   pthread_mutex_init(&queue->mutex, NULL);
+   pthread_cond_init(&queue->not_full, NULL);
+
+   if (!(queue->buffer = chck_calloc_of(qsize, msize)) ||
+       !(queue->slots = chck_calloc_of(qsize, sizeof(struct chck_steal_queue_slot))))
+      goto fail;
+
+   for (size_t i = 0; i < qsize; ++i) {
+      queue->slots[i].queue = queue;
+      queue->slots[i].index = i;
+   }
+
+   queue->msize = msize;
+   queue->qsize = qsize;
+   queue->work = work;
+   queue->callback = callback;
+   queue->destructor = destructor;
+   return true;
+
+fail:
+   chck_steal_queue_release(queue);
+   return false;
+}
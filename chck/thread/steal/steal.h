@@ -0,0 +1,124 @@
+#ifndef __chck_steal__
+#define __chck_steal__
+
+#include <chck/macros.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+
+struct chck_steal_group {
+   // number of spawned tasks in the group that have not finished yet
+   size_t pending;
+};
+
+struct chck_steal_task {
+   void (*function)(struct chck_steal_task *task);
+   struct chck_steal_group *group;
+
+   // link in the injection list, for tasks spawned outside the worker threads
+   struct chck_steal_task *next;
+};
+
+struct chck_steal_deque {
+   // owner pushes and pops at bottom, thieves take from top
+   char pad0[CHCK_CACHE_LINE];
+   int64_t top;
+   char pad1[CHCK_CACHE_LINE - sizeof(int64_t)];
+   int64_t bottom;
+   char pad2[CHCK_CACHE_LINE - sizeof(int64_t)];
+   struct chck_steal_task **buffer;
+   size_t mask;
+};
+
+struct chck_steal_worker {
+   struct chck_steal_deque deque;
+   struct chck_steal *steal;
+   pthread_t thread;
+   uint32_t seed;
+};
+
+struct chck_steal {
+   struct chck_steal_worker *workers;
+   size_t count;
+
+   // tasks spawned from threads that are not workers of this scheduler
+   struct {
+      struct chck_steal_task *first, *last;
+      pthread_mutex_t mutex;
+   } inject;
+
+   // number of workers waiting for tasks, the mutex and condition are only used for sleeping
+   // waiters are the threads sleeping in chck_steal_group_wait, they are counted in sleepers too
+   size_t sleepers, waiters;
+   pthread_mutex_t mutex;
+   pthread_cond_t notify;
+
+   // thread local worker key
+   pthread_key_t key;
+   bool cancel;
+};
+
+/**
+ * Work stealing scheduler.
+ * Each worker thread has its own deque of tasks (Chase-Lev), it pushes and pops tasks at one end, while idle workers steal from the other end of random victims.
+ * Spawning from inside a task goes to the deque of the current worker, so recursive workloads stay mostly on one core and spread only when other workers run out of work.
+ * Spawning from other threads goes through a shared injection list.
+ *
+ * Tasks are intrusive, embed chck_steal_task in your own struct and keep it alive until the task has ran.
+ * Tasks spawned to same group can be waited with chck_steal_group_wait, the waiting thread runs pending tasks while it waits, so waiting inside a task does not deadlock.
+ * Once there is nothing to help with, the waiting thread sleeps until a task is spawned or a group finishes.
+ * If the deque of the worker is full (capacity is rounded up to power of two), the task is ran immediately instead.
+ *
+ * Tasks that have not ran when scheduler is released are dropped.
+ */
+
+CHCK_NONULL bool chck_steal(struct chck_steal *steal, size_t nthreads, size_t capacity);
+void chck_steal_release(struct chck_steal *steal);
+CHCK_NONULLV(1, 3) void chck_steal_spawn(struct chck_steal *steal, struct chck_steal_group *group, struct chck_steal_task *task);
+CHCK_NONULL void chck_steal_group_wait(struct chck_steal *steal, struct chck_steal_group *group);
+
+struct chck_steal_queue_slot;
+
+struct chck_steal_queue {
+   struct chck_steal *steal;
+   struct chck_steal_queue_slot *slots;
+   void *buffer;
+
+   // every task of the queue is in this group
+   struct chck_steal_group group;
+
+   void (*work)();
+   void (*callback)();
+   void (*destructor)();
+   size_t msize;
+   size_t qsize;
+
+   // positions only ever increase, the slot for position is (position % qsize)
+   size_t head, tail;
+   pthread_t self;
+
+   // creator waiting for the head task to finish, when the queue is full
+   pthread_mutex_t mutex;
+   pthread_cond_t not_full;
+   bool waiting;
+};
+
+/**
+ * Adapter with the chck_tqueue interface, that runs the tasks on chck_steal scheduler.
+ * Like chck_tqueue, work(data) is ran on the workers, and callback(data) and destructor(data) on the creator thread in chck_steal_queue_collect.
+ * Multiple queues can share one scheduler.
+ *
+ * Unlike chck_tqueue, tasks may be added only from the creator thread.
+ * When the queue is full and block is non-zero, chck_steal_queue_add_task sleeps until the oldest task is done and collects it.
+ * (like chck_tqueue, the value of block is not used as interval, any non-zero value blocks)
+ * Release waits for tasks that are still running.
+ */
+
+CHCK_NONULL bool chck_steal_queue_add_task(struct chck_steal_queue *queue, void *data, useconds_t block);
+CHCK_NONULL size_t chck_steal_queue_collect(struct chck_steal_queue *queue);
+void chck_steal_queue_release(struct chck_steal_queue *queue);
+CHCK_NONULLV(1, 2, 5) bool chck_steal_queue(struct chck_steal_queue *queue, struct chck_steal *steal, size_t qsize, size_t msize, void (*work)(), void (*callback)(), void (*destructor)());
+
+#endif /* __chck_steal__ */
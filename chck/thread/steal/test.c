@@ -0,0 +1,146 @@
+#include "steal.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef NDEBUG
+#include <assert.h>
+
+struct fib {
+   struct chck_steal_task task;
+   struct chck_steal *steal;
+   uint64_t n, result;
+};
+
+static uint64_t
+fib_serial(uint64_t n)
+{
+   return (n < 2 ? n : fib_serial(n - 1) + fib_serial(n - 2));
+}
+
+static void
+fib(struct fib *f)
+{
+   assert(f);
+
+   if (f->n < 12) {
+      f->result = fib_serial(f->n);
+      return;
+   }
+
+   struct chck_steal_group group = {0};
+   struct fib a = { .task.function = (void*)fib, .steal = f->steal, .n = f->n - 1 };
+   struct fib b = { .task.function = (void*)fib, .steal = f->steal, .n = f->n - 2 };
+   chck_steal_spawn(f->steal, &group, &a.task);
+   chck_steal_spawn(f->steal, &group, &b.task);
+   chck_steal_group_wait(f->steal, &group);
+   f->result = a.result + b.result;
+}
+
+struct item {
+   int a;
+   int c;
+};
+
+static void
+work(struct item *item)
+{
+   assert(item);
+   item->c /= 5;
+}
+
+static size_t collected;
+
+static void
+callback(struct item *item)
+{
+   assert(item);
+   assert((item->a == 1 && item->c == 2) || (item->a == 2 && item->c == 1));
+   ++collected;
+}
+
+static void
+destructor(struct item *item)
+{
+   assert(item);
+   assert((item->a == 1 && item->c == 2) || (item->a == 2 && item->c == 1));
+}
+
+static void
+nap(struct chck_steal_task *task)
+{
+   assert(task);
+   usleep(200 * 1000);
+}
+
+static uint64_t
+cpu_us(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(void)
+{
+   struct chck_steal steal;
+   assert(chck_steal(&steal, 4, 64));
+
+   /* TEST: recursive spawning */
+   {
+      struct chck_steal_group group = {0};
+      struct fib f = { .task.function = (void*)fib, .steal = &steal, .n = 27 };
+      chck_steal_spawn(&steal, &group, &f.task);
+      chck_steal_group_wait(&steal, &group);
+      assert(f.result == fib_serial(27));
+   }
+
+   /* TEST: many tasks from outside */
+   {
+      struct chck_steal_group group = {0};
+      struct fib f[256];
+      for (size_t i = 0; i < 256; ++i) {
+         f[i] = (struct fib){ .task.function = (void*)fib, .steal = &steal, .n = i % 16 };
+         chck_steal_spawn(&steal, &group, &f[i].task);
+      }
+      chck_steal_group_wait(&steal, &group);
+
+      for (size_t i = 0; i < 256; ++i)
+         assert(f[i].result == fib_serial(i % 16));
+   }
+
+   /* TEST: waiting for task that runs elsewhere sleeps */
+   {
+      struct chck_steal_group group = {0};
+      struct chck_steal_task task = { .function = nap };
+      chck_steal_spawn(&steal, &group, &task);
+
+      // give worker time to take it, so there is nothing left to help with
+      usleep(10 * 1000);
+      const uint64_t start = cpu_us();
+      chck_steal_group_wait(&steal, &group);
+      assert(cpu_us() - start < 50 * 1000);
+   }
+
+   /* TEST: tqueue adapter */
+   {
+      struct chck_steal_queue queue;
+      assert(chck_steal_queue(&queue, &steal, 32, sizeof(struct item), work, callback, destructor));
+
+      for (size_t i = 0; i < 0xFFFF; ++i) {
+         struct item a = { 1, 10 };
+         assert(chck_steal_queue_add_task(&queue, &a, 1));
+
+         struct item b = { 2, 5 };
+         assert(chck_steal_queue_add_task(&queue, &b, 1));
+      }
+
+      while (chck_steal_queue_collect(&queue));
+      assert(collected == 0xFFFF * 2);
+      chck_steal_queue_release(&queue);
+   }
+
+   chck_steal_release(&steal);
+   return EXIT_SUCCESS;
+}